@@ -0,0 +1,113 @@
+#include "ntdcp/caching-set.hpp"
+#include "map-list-caching-set.hpp"
+
+#include <chrono>
+#include <random>
+#include <memory>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <iomanip>
+
+namespace
+{
+
+/// Package ids as they come from network: mostly new ones with some duplicates from flooding
+std::vector<uint16_t> make_package_ids(size_t count)
+{
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::uniform_int_distribution<int> back(1, 50);
+
+    std::vector<uint16_t> ids;
+    ids.reserve(count);
+    uint16_t next_id = uint16_t(generator());
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!ids.empty() && percent(generator) < 30)
+            ids.push_back(ids[ids.size() - std::min<size_t>(ids.size(), back(generator))]);
+        else
+            ids.push_back(next_id++);
+    }
+    return ids;
+}
+
+std::vector<uint32_t> make_socket_keys(size_t count, uint32_t distinct)
+{
+    std::mt19937 generator(24);
+    std::uniform_int_distribution<uint32_t> key(0, distinct - 1);
+
+    std::vector<uint32_t> keys(count);
+    for (auto& k : keys)
+        k = key(generator) * 2654435761u;
+    return keys;
+}
+
+template<typename Function>
+void measure(const std::string& name, size_t operations, Function&& function)
+{
+    auto begin = std::chrono::steady_clock::now();
+    size_t result = function();
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - begin).count() / operations;
+    std::cout << std::left << std::setw(48) << name << std::right << std::setw(10)
+              << std::fixed << std::setprecision(2) << ns << " ns/op"
+              << "   (hits: " << result << ")" << std::endl;
+}
+
+template<typename Set>
+size_t run_set(const std::vector<uint16_t>& ids, size_t capacity)
+{
+    Set set(capacity);
+    size_t hits = 0;
+    for (uint16_t id : ids)
+        hits += set.check_update(id) ? 1 : 0;
+    return hits;
+}
+
+template<typename Map>
+size_t run_map(const std::vector<uint32_t>& keys, size_t capacity)
+{
+    Map map(capacity);
+    auto socket = std::make_shared<int>(0);
+    size_t hits = 0;
+    for (uint32_t key : keys)
+    {
+        auto found = map.get_update(key);
+        if (found.has_value())
+        {
+            hits++;
+            if (key % 7 == 0)
+                map.erase(key);
+        } else {
+            map.put_update(key, socket);
+        }
+    }
+    return hits;
+}
+
+}
+
+int main()
+{
+    constexpr size_t operations = 2000000;
+
+    auto ids = make_package_ids(operations);
+    for (size_t capacity : {100, 1000})
+    {
+        std::string suffix = "<uint16_t>, capacity " + std::to_string(capacity);
+        measure("MapListCachingSet" + suffix, operations,
+                [&] { return run_set<MapListCachingSet<uint16_t>>(ids, capacity); });
+        measure("CachingSet" + suffix, operations,
+                [&] { return run_set<CachingSet<uint16_t>>(ids, capacity); });
+    }
+
+    auto keys = make_socket_keys(operations, 40);
+    using Value = std::weak_ptr<int>;
+    measure("MapListCachingMap<uint32_t, weak_ptr>, capacity 10", operations,
+            [&] { return run_map<MapListCachingMap<uint32_t, Value>>(keys, 10); });
+    measure("CachingMap<uint32_t, weak_ptr>, capacity 10", operations,
+            [&] { return run_map<CachingMap<uint32_t, Value>>(keys, 10); });
+    return 0;
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <memory>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+namespace ntdcp
+{
+
+/**
+ * @brief The BufferPool class is a fixed-size blocks allocator with several size classes.
+ * Every size class grows by slabs of blocks that are never returned to the heap until
+ * the pool is destroyed, so after warm-up allocations do not touch malloc at all.
+ * Requests that do not fit any size class or exceed its block limit go to the heap
+ * and are counted as fallbacks.
+ */
+class BufferPool
+{
+public:
+    struct SizeClassOptions
+    {
+        size_t block_size = 0;
+        /// Maximal blocks count in the class, 0 means unlimited
+        size_t max_blocks = 0;
+        size_t blocks_per_slab = 8;
+    };
+
+    struct Options
+    {
+        // The smallest class fits buffer object with control block only, it is used by slices
+        std::vector<SizeClassOptions> size_classes{
+            {128, 0, 32},
+            {256, 0, 16},
+            {1024, 0, 8},
+            {4096, 0, 2}
+        };
+    };
+
+    struct Statistics
+    {
+        size_t block_size = 0;
+        size_t blocks_total = 0;
+        size_t blocks_in_use = 0;
+        size_t high_water = 0;
+        size_t fallback_allocations = 0;
+    };
+
+    struct Block
+    {
+        void* data = nullptr;
+        size_t size = 0;
+    };
+
+    /**
+     * @brief Pool used by Buffer::create
+     */
+    static BufferPool& global();
+
+    BufferPool();
+    explicit BufferPool(const Options& options);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    /**
+     * @brief Replace size classes configuration. Possible only when no block is in use
+     * @return true if pool was reconfigured
+     */
+    bool configure(const Options& options);
+
+    /**
+     * @brief Allocate block with at least size bytes of usable memory
+     * @return Block with real usable size that may be greater than requested
+     */
+    Block allocate(size_t size);
+    static void deallocate(void* data);
+
+    std::vector<Statistics> statistics() const;
+    size_t oversized_allocations() const;
+
+private:
+    struct SizeClass;
+
+    struct alignas(alignof(std::max_align_t)) BlockHeader
+    {
+        SizeClass* owner = nullptr;
+        BlockHeader* next_free = nullptr;
+    };
+
+    struct SizeClass
+    {
+        BufferPool* pool = nullptr;
+        SizeClassOptions options;
+        BlockHeader* free_list = nullptr;
+        std::vector<void*> slabs;
+        Statistics stats;
+
+        bool grow();
+    };
+
+    class SpinLock
+    {
+    public:
+        void lock();
+        void unlock();
+    private:
+        std::atomic_flag m_flag = ATOMIC_FLAG_INIT;
+    };
+
+    static Block heap_allocate(size_t size);
+    void release_slabs();
+
+    std::vector<std::unique_ptr<SizeClass>> m_classes;
+    size_t m_oversized_allocations = 0;
+    mutable SpinLock m_lock;
+};
+
+/**
+ * @brief The BufferAllocator class is used with std::allocate_shared to put shared_ptr control block,
+ * the object and a payload tail into one pool block. Pointer to the tail and its real size are written
+ * to tail argument during allocation
+ */
+template<typename T>
+class BufferAllocator
+{
+public:
+    using value_type = T;
+
+    BufferAllocator(BufferPool& pool, size_t tail_size, BufferPool::Block* tail) :
+        m_pool(&pool), m_tail_size(tail_size), m_tail(tail)
+    {}
+
+    template<typename U>
+    BufferAllocator(const BufferAllocator<U>& other) :
+        m_pool(other.m_pool), m_tail_size(other.m_tail_size), m_tail(other.m_tail)
+    {}
+
+    T* allocate(size_t n)
+    {
+        constexpr size_t alignment = alignof(std::max_align_t);
+        size_t head_size = (n * sizeof(T) + alignment - 1) / alignment * alignment;
+        BufferPool::Block block = m_pool->allocate(head_size + m_tail_size);
+        if (m_tail)
+        {
+            m_tail->data = reinterpret_cast<uint8_t*>(block.data) + head_size;
+            m_tail->size = block.size - head_size;
+        }
+        return reinterpret_cast<T*>(block.data);
+    }
+
+    void deallocate(T* p, size_t)
+    {
+        BufferPool::deallocate(p);
+    }
+
+    template<typename U>
+    bool operator==(const BufferAllocator<U>& right) const
+    {
+        return m_pool == right.m_pool;
+    }
+
+    template<typename U>
+    bool operator!=(const BufferAllocator<U>& right) const
+    {
+        return !(*this == right);
+    }
+
+private:
+    template<typename U>
+    friend class BufferAllocator;
+
+    BufferPool* m_pool;
+    size_t m_tail_size;
+    BufferPool::Block* m_tail;
+};
+
+}
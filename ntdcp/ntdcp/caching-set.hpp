@@ -1,93 +1,308 @@
 #pragma once
 
-#include <set>
-#include <map>
-#include <list>
+#include <vector>
 #include <optional>
+#include <functional>
+#include <utility>
+#include <limits>
+#include <cstdint>
 #include <cstdlib>
 
-
-template<typename T>
-class CachingSet
+/**
+ * @brief The LruHashTable class is a fixed capacity hash table that forgets least recently
+ * used entry when it is full. Open addressing with linear probing is used, slots contain
+ * only indexes of entries and entries are linked into LRU list by indexes, so all memory
+ * is allocated in constructor and never after
+ */
+template<typename KeyType, typename ValueType, typename Hash = std::hash<KeyType>>
+class LruHashTable
 {
 public:
-    CachingSet(size_t size) :
-        m_size(size)
-    {}
+    explicit LruHashTable(size_t capacity) :
+        m_capacity(capacity != 0 ? capacity : 1)
+    {
+        // Load factor is kept not more than 0.5 to make probe sequences short
+        size_t slots_count = 2;
+        m_shift = 63;
+        while (slots_count < 2 * m_capacity)
+        {
+            slots_count *= 2;
+            m_shift--;
+        }
+        m_mask = slots_count - 1;
 
-    bool check_update(const T& obj)
+        m_slots.assign(slots_count, npos);
+        m_entries.resize(m_capacity);
+        for (size_t i = 0; i < m_capacity; i++)
+        {
+            m_entries[i].next = i + 1 < m_capacity ? uint32_t(i + 1) : npos;
+        }
+        m_free = 0;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+    /**
+     * @brief Find value without changing entries order
+     */
+    ValueType* find(const KeyType& key)
+    {
+        size_t slot = find_slot(key, hash(key));
+        if (m_slots[slot] == npos)
+            return nullptr;
+        return &m_entries[m_slots[slot]].value;
+    }
+
+    /**
+     * @brief Find value and mark it as the most recently used
+     */
+    ValueType* find_update(const KeyType& key)
+    {
+        size_t slot = find_slot(key, hash(key));
+        if (m_slots[slot] == npos)
+            return nullptr;
+        uint32_t index = m_slots[slot];
+        touch(index);
+        return &m_entries[index].value;
+    }
+
+    /**
+     * @brief Find or create entry and mark it as the most recently used. Least recently used
+     * entry is forgotten if there is no free space
+     * @return Value and true if the key already existed
+     */
+    std::pair<ValueType*, bool> insert_update(const KeyType& key)
     {
-        auto it = m_map.find(obj);
-        if (it != m_map.end())
+        uint32_t key_hash = hash(key);
+        size_t slot = find_slot(key, key_hash);
+        if (m_slots[slot] != npos)
         {
-            // update list
-            auto list_it = it->second;
-            m_list.erase(list_it);
-            m_list.push_back(&it->first);
-            it->second = std::prev(m_list.end());
-            return true;
+            uint32_t index = m_slots[slot];
+            touch(index);
+            return {&m_entries[index].value, true};
         }
 
-        if (m_map.size() == m_size)
+        if (m_size == m_capacity)
         {
-            m_map.erase(*m_list.front());
-            m_list.pop_front();
+            remove(m_oldest);
+            // Slot may be moved by backward shift
+            slot = find_slot(key, key_hash);
         }
 
-        auto jt = m_map.emplace(obj, m_list.end());
-        m_list.push_back(&jt.first->first);
-        jt.first->second = std::prev(m_list.end());
-        return false;
+        uint32_t index = m_free;
+        Entry& entry = m_entries[index];
+        m_free = entry.next;
+        entry.key = key;
+        entry.hash = key_hash;
+        link_newest(index);
+        m_slots[slot] = index;
+        m_size++;
+        return {&entry.value, false};
+    }
+
+    bool erase(const KeyType& key)
+    {
+        size_t slot = find_slot(key, hash(key));
+        if (m_slots[slot] == npos)
+            return false;
+        remove(m_slots[slot]);
+        return true;
+    }
+
+    /**
+     * @brief Value of entry that will be forgotten first or nullptr if table is empty
+     */
+    const ValueType* oldest() const
+    {
+        if (m_oldest == npos)
+            return nullptr;
+        return &m_entries[m_oldest].value;
+    }
+
+    /**
+     * @brief Call function(key, value) for every entry from the least to the most recently used
+     */
+    template<typename Function>
+    void for_each(Function&& function) const
+    {
+        for (uint32_t index = m_oldest; index != npos; index = m_entries[index].next)
+            function(m_entries[index].key, m_entries[index].value);
     }
 
 private:
-    using ListType = std::list<const T*>;
+    constexpr static uint32_t npos = std::numeric_limits<uint32_t>::max();
+
+    struct Entry
+    {
+        KeyType key{};
+        ValueType value{};
+        uint32_t hash = 0;
+        uint32_t prev = npos;
+        uint32_t next = npos;
+    };
+
+    uint32_t hash(const KeyType& key) const
+    {
+        // Fibonacci hashing spreads simple hashes like identity for integers
+        uint64_t h = uint64_t(m_hash(key)) * 0x9E3779B97F4A7C15ull;
+        return uint32_t(h >> 32);
+    }
 
-    ListType m_list;
-    std::map<T, typename ListType::iterator> m_map;
+    size_t home_slot(uint32_t key_hash) const
+    {
+        return size_t((uint64_t(key_hash) << 32) >> m_shift) & m_mask;
+    }
 
-    size_t m_size;
+    /// @return Slot with the key or the first empty slot of probe sequence
+    size_t find_slot(const KeyType& key, uint32_t key_hash) const
+    {
+        for (size_t slot = home_slot(key_hash); ; slot = (slot + 1) & m_mask)
+        {
+            uint32_t index = m_slots[slot];
+            if (index == npos)
+                return slot;
+            const Entry& entry = m_entries[index];
+            if (entry.hash == key_hash && entry.key == key)
+                return slot;
+        }
+    }
+
+    void remove(uint32_t index)
+    {
+        Entry& entry = m_entries[index];
+        size_t slot = home_slot(entry.hash);
+        while (m_slots[slot] != index)
+            slot = (slot + 1) & m_mask;
+
+        // Backward shift deletion keeps probe sequences without tombstones
+        for (size_t next = (slot + 1) & m_mask; m_slots[next] != npos; next = (next + 1) & m_mask)
+        {
+            size_t home = home_slot(m_entries[m_slots[next]].hash);
+            bool stays = slot <= next ? (slot < home && home <= next) : (slot < home || home <= next);
+            if (stays)
+                continue;
+            m_slots[slot] = m_slots[next];
+            slot = next;
+        }
+        m_slots[slot] = npos;
+
+        unlink(index);
+        entry.key = KeyType();
+        entry.value = ValueType();
+        entry.next = m_free;
+        m_free = index;
+        m_size--;
+    }
+
+    void touch(uint32_t index)
+    {
+        if (index == m_newest)
+            return;
+        unlink(index);
+        link_newest(index);
+    }
+
+    void link_newest(uint32_t index)
+    {
+        Entry& entry = m_entries[index];
+        entry.prev = m_newest;
+        entry.next = npos;
+        if (m_newest != npos)
+            m_entries[m_newest].next = index;
+        m_newest = index;
+        if (m_oldest == npos)
+            m_oldest = index;
+    }
+
+    void unlink(uint32_t index)
+    {
+        Entry& entry = m_entries[index];
+        if (entry.prev != npos)
+            m_entries[entry.prev].next = entry.next;
+        else
+            m_oldest = entry.next;
+
+        if (entry.next != npos)
+            m_entries[entry.next].prev = entry.prev;
+        else
+            m_newest = entry.prev;
+
+        entry.prev = entry.next = npos;
+    }
+
+    std::vector<uint32_t> m_slots;
+    std::vector<Entry> m_entries;
+
+    size_t m_capacity;
+    size_t m_size = 0;
+    size_t m_mask = 0;
+    int m_shift = 0;
+
+    uint32_t m_oldest = npos;
+    uint32_t m_newest = npos;
+    uint32_t m_free = npos;
+
+    Hash m_hash;
 };
 
-template<typename KeyType, typename ValueType>
+template<typename T, typename Hash = std::hash<T>>
+class CachingSet
+{
+public:
+    CachingSet(size_t size) :
+        m_table(size)
+    {}
+
+    /**
+     * @brief Check if object was seen recently and remember it
+     * @return true if object was already in the set
+     */
+    bool check_update(const T& obj)
+    {
+        return m_table.insert_update(obj).second;
+    }
+
+private:
+    struct Empty {};
+
+    LruHashTable<T, Empty, Hash> m_table;
+};
+
+template<typename KeyType, typename ValueType, typename Hash = std::hash<KeyType>>
 class CachingMap
 {
 public:
     CachingMap(size_t size) :
-        m_size(size)
+        m_table(size)
     {}
 
     bool erase(const KeyType& key)
     {
-        auto it = m_map.find(key);
-        if (it == m_map.end())
-            return false;
-
-        auto list_iter = it->second.first;
-        m_list.erase(list_iter);
-        m_map.erase(it);
-        return true;
+        return m_table.erase(key);
     }
 
     std::optional<ValueType*> get(const KeyType& key)
     {
-        auto it = m_map.find(key);
-        if (it == m_map.end())
+        ValueType* value = m_table.find(key);
+        if (!value)
             return std::nullopt;
-        return &it->second.second;
+        return value;
     }
 
     std::optional<ValueType*> get_update(const KeyType& key)
     {
-        auto it = m_map.find(key);
-        if (it == m_map.end())
+        ValueType* value = m_table.find_update(key);
+        if (!value)
             return std::nullopt;
-
-        auto list_iter = it->second.first;
-        m_list.push_back(*list_iter);
-        m_list.erase(list_iter);
-        it->second.first = std::prev(m_list.end());
-        return &it->second.second;
+        return value;
     }
 
     /**
@@ -98,36 +313,20 @@ public:
      */
     bool put_update(const KeyType& key, const ValueType& value)
     {
-        auto it = m_map.find(key);
-        if (it != m_map.end())
-        {
-            auto list_iter = it->second.first;
-            m_list.push_back(*list_iter);
-            m_list.erase(list_iter);
-            it->second.first = std::prev(m_list.end());
-            it->second.second = value;
-            return true;
-        }
-
-        if (m_list.size() == m_size)
-        {
-            const KeyType* k = m_list.front();
-            m_list.pop_front();
-            m_map.erase(*k);
-        }
-
-        auto emp = m_map.emplace(key, std::make_pair(m_list.end(), value));
-        m_list.push_back(&emp.first->first);
-        emp.first->second.first = std::prev(m_list.end());
-        return false;
+        auto result = m_table.insert_update(key);
+        *result.first = value;
+        return result.second;
     }
 
+    /**
+     * @brief Call function(key, value) for every entry from the least to the most recently used
+     */
+    template<typename Function>
+    void for_each(Function&& function) const
+    {
+        m_table.for_each(std::forward<Function>(function));
+    }
 
 private:
-    using ListType = std::list<const KeyType*>;
-
-    ListType m_list;
-    std::map<KeyType, std::pair<typename ListType::iterator, ValueType>> m_map;
-
-    size_t m_size;
+    LruHashTable<KeyType, ValueType, Hash> m_table;
 };
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "ntdcp/utils.hpp"
+#include "ntdcp/checksum.hpp"
+#include "ntdcp/fec.hpp"
 
 #include <cstdint>
 
@@ -16,37 +18,142 @@ struct ChannelHeader
     uint16_t size = 0;
     uint32_t checksum = 0;
 };
+
+/**
+ * Header with its own checksum, so false header may be rejected as soon as it is received
+ * and not after size bytes are received. Magic number differs from ChannelHeader one
+ */
+struct ChannelExtendedHeader
+{
+    constexpr static uint16_t magic_number_value = 0x80AB;
+    uint16_t magic = magic_number_value;
+    uint16_t size = 0;
+    uint32_t checksum = 0;
+    /// CRC-16 of all previous fields
+    uint16_t header_checksum = 0;
+};
 #pragma pack(pop)
 
+/**
+ * @brief The ChannelLayer class splits byte stream into frames. Decoder is a streaming one:
+ * every received byte is scanned for header and checksummed only once per candidate frame,
+ * so CPU time and memory per input byte are bounded by Options::max_candidates.
+ * Decoder keeps state of its stream, so every stream needs its own ChannelLayer instance.
+ *
+ * Three framing types are supported:
+ *  - header: frame is a header with magic number, size and checksum followed by body. Frame
+ *    boundaries are found by header search and checksum verification
+ *  - cobs: body with 4 bytes of checksum is encoded with Consistent Overhead Byte Stuffing
+ *    and terminated by zero byte, so boundaries are found deterministically
+ *  - length_prefix: body is prefixed with its 16-bit size only. Only for links that never lose
+ *    or corrupt data, checksum is not used
+ */
 class ChannelLayer
 {
 public:
-    ChannelLayer();
-    std::vector<Buffer::ptr> decode(SerialReadAccessor& ring_buffer);
-    void encode(SegmentBuffer& frame);
+    enum class Framing
+    {
+        header = 0,
+        cobs,
+        length_prefix
+    };
 
-private:
-    enum class State
+    struct Options
     {
-        waiting_header = 0,
-        waiting_buffer
+        /// Both sides of the link should use the same framing
+        Framing framing = Framing::header;
+        /// Both sides of the link should use the same checksum. With Checksum::Type::none the first
+        /// found header is trusted, so header framing needs a link that drops corrupted data
+        Checksum::Type checksum = Checksum::Type::legacy_hash;
+        /// Maximal count of simultaneously tracked headers, i.e. possible frame begins.
+        /// Following headers are processed when some of tracked ones are resolved
+        size_t max_candidates = 16;
+        /// Frames with bigger size are ignored. Should not exceed incoming buffer capacity minus framing overhead,
+        /// PhysicalInterfaceOptions::channel_options() limits it by ring_buffer_size with max_frame_size_for()
+        size_t max_frame_size = 0xFFFF;
+        /// Use ChannelExtendedHeader instead of ChannelHeader for header framing.
+        /// Both sides of the link should use the same header
+        bool extended_header = false;
+        /// Reed-Solomon parity bytes per 255 bytes block, 0 disables FEC. Up to fec_parity / 2
+        /// corrupted bytes per block are repaired before checksum verification
+        size_t fec_parity = 0;
+        /// Encode frame into single buffer. Useful for interfaces that cannot send data by segments:
+        /// data is copied and checksummed in one pass instead of two separate ones
+        bool contiguous_output = false;
     };
 
-    State m_state = State::waiting_header;
-    ChannelHeader m_header;
+    ChannelLayer();
+    explicit ChannelLayer(const Options& options);
+
+    std::vector<Buffer::ptr> decode(SerialReadAccessor& ring_buffer);
+    /**
+     * @brief Add framing to the frame
+     * @return false if frame cannot be encoded because it is longer than length_prefix framing
+     *         allows, frame is left unchanged
+     */
+    bool encode(SegmentBuffer& frame);
+
+    const Options& options() const;
+    /// Largest frame that is accepted by receiver with the same options
+    size_t max_payload_size() const;
+    /// Count of times when frame boundaries were lost and buffered data was dropped
+    size_t desync_count() const;
 
-    struct DecodingInstance
+    /**
+     * @brief Largest Options::max_frame_size that makes every frame fit into incoming stream buffer
+     * with all framing overhead, so no frame can stall the decoder by never being completed
+     */
+    static size_t max_frame_size_for(const Options& options, size_t stream_buffer_size);
+
+private:
+    struct Candidate
     {
         size_t body_begin = 0;
+        /// Bytes of body already added to checksum or just received if FEC is used
+        size_t hashed = 0;
+        uint32_t checksum_state = 0;
         ChannelHeader header;
+        /// Body copied during checksum calculation, used when candidate is alone in the stream
+        Buffer::ptr body;
+
+        size_t end() const;
+        bool complete() const;
     };
 
-    Buffer::ptr decode_single(SerialReadAccessor& ring_buffer);
-    Buffer::ptr find_sucessful_instance(SerialReadAccessor& ring_buffer);
-    void find_next_headers(SerialReadAccessor& ring_buffer);
+    size_t header_size() const;
+    /**
+     * @brief Read header at given position as candidate
+     * @return false if header is broken
+     */
+    bool read_header(SerialReadAccessor& accessor, size_t pos, Candidate& candidate) const;
+
+    Buffer::ptr decode_single(SerialReadAccessor& accessor);
+    Buffer::ptr decode_single_cobs(SerialReadAccessor& accessor);
+    Buffer::ptr decode_single_length_prefix(SerialReadAccessor& accessor);
+    size_t cobs_checksum_size() const;
+    void encode_cobs(SegmentBuffer& frame, uint32_t checksum);
+    Buffer::ptr fec_encode(const SegmentBuffer& frame) const;
+    /**
+     * @brief Register headers from the stream as frame candidates
+     * @return false if search was stopped because of candidates limit
+     */
+    bool find_next_headers(SerialReadAccessor& accessor);
+    void update_checksums(SerialReadAccessor& accessor);
+    /// @return Verified (and repaired) frame body or nullptr
+    Buffer::ptr read_body(SerialReadAccessor& accessor, const Candidate& frame) const;
+    void skip_frame(SerialReadAccessor& accessor, size_t frame_end);
+
+    Options m_options;
+    Checksum m_checksum;
+    Checksum m_header_checksum{Checksum::Type::crc16};
+    ReedSolomon m_fec;
 
-    std::list<DecodingInstance> m_decoding_instances;
+    std::vector<Candidate> m_candidates;
+    /// Position in accessor from which next header (or frame delimiter) search should start
     size_t m_header_search_pos = 0;
+    /// Frame delimiter was lost, so data should be dropped up to the next one
+    bool m_cobs_discarding = false;
+    size_t m_desync_count = 0;
 };
 
 }
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+
+namespace ntdcp
+{
+
+/**
+ * @brief The Checksum class is a streaming checksum calculator with selectable algorithm:
+ *  - legacy_hash: hash_Ly, byte-at-a-time, compatible with older nodes
+ *  - crc32c: Castagnoli CRC, slicing-by-8 tables or SSE4.2 instruction when CPU supports it
+ *  - crc16: CRC-16/CCITT-FALSE with 16-entries table for small MCUs
+ *  - none: always zero, for links that guarantee integrity themselves
+ *
+ * Usage: state = begin(), state = update(state, ...) for every data part, result = finish(state)
+ */
+class Checksum
+{
+public:
+    enum class Type
+    {
+        legacy_hash = 0,
+        crc32c,
+        crc16,
+        none
+    };
+
+    /**
+     * @param type            Algorithm
+     * @param allow_hardware  Use CPU instructions if they are available
+     */
+    explicit Checksum(Type type = Type::legacy_hash, bool allow_hardware = true);
+
+    Type type() const;
+
+    uint32_t begin() const;
+    uint32_t update(uint32_t state, const void* data, size_t size) const;
+    uint32_t finish(uint32_t state) const;
+
+    /**
+     * @brief Copy data and update checksum in one pass, so data is read from memory only once
+     */
+    uint32_t update_copy(uint32_t state, void* dst, const void* src, size_t size) const;
+
+    uint32_t compute(const void* data, size_t size) const;
+
+    static bool hardware_crc32c_supported();
+
+private:
+    using UpdateFunction = uint32_t (*)(uint32_t state, const uint8_t* data, size_t size);
+    using UpdateCopyFunction = uint32_t (*)(uint32_t state, uint8_t* dst, const uint8_t* src, size_t size);
+
+    Type m_type;
+    UpdateFunction m_update;
+    UpdateCopyFunction m_update_copy;
+    uint32_t m_initial;
+    uint32_t m_final_xor;
+};
+
+}
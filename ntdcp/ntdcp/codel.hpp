@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+
+namespace ntdcp
+{
+
+/**
+ * @brief The CoDel class is active queue management by packages sojourn time (RFC 8289).
+ * When every package leaving the queue waited longer than target during interval, queue is
+ * considered standing and packages are dropped at the head with increasing rate
+ * interval / sqrt(count) until sojourn time gets below target
+ */
+class CoDel
+{
+public:
+    struct Options
+    {
+        /// Acceptable standing queue delay, 0 disables dropping
+        std::chrono::milliseconds target{100};
+        /// Time for which delay may be above target, about the worst round trip time
+        std::chrono::milliseconds interval{1000};
+    };
+
+    CoDel();
+    explicit CoDel(const Options& options);
+
+    const Options& options() const;
+
+    /**
+     * @brief Decide what to do with the package taken from the queue head
+     * @param sojourn      Time package was in the queue
+     * @param queue_empty  It was the last package in the queue
+     * @return true if package should be dropped
+     */
+    bool should_drop(std::chrono::steady_clock::duration sojourn, std::chrono::steady_clock::time_point now, bool queue_empty);
+
+    bool dropping() const;
+
+private:
+    bool ok_to_drop(std::chrono::steady_clock::duration sojourn, std::chrono::steady_clock::time_point now, bool queue_empty);
+    std::chrono::steady_clock::time_point control_law(std::chrono::steady_clock::time_point t) const;
+
+    Options m_options;
+    bool m_above_target = false;
+    std::chrono::steady_clock::time_point m_first_above_time;
+    bool m_dropping = false;
+    std::chrono::steady_clock::time_point m_drop_next;
+    uint32_t m_count = 0;
+    uint32_t m_last_count = 0;
+};
+
+}
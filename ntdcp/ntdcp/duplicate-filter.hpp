@@ -0,0 +1,75 @@
+#pragma once
+
+#include "ntdcp/caching-set.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+
+namespace ntdcp
+{
+
+/**
+ * @brief The DuplicateFilter class remembers packages seen during last time window.
+ * Packages are identified by source address and package id, so packages of different
+ * nodes never collide. When the least recently seen package is still inside the window
+ * but there is no free space, capacity is doubled, so it follows the packages rate
+ * up to max_capacity. Capacity is halved back down to initial_capacity when a whole window
+ * used less than a quarter of it. Shrinking is checked once per window
+ */
+class DuplicateFilter
+{
+public:
+    struct Options
+    {
+        /// Package is a duplicate if it was seen not earlier than window ago
+        std::chrono::milliseconds window{5000};
+        size_t initial_capacity = 100;
+        size_t max_capacity = 8192;
+    };
+
+    DuplicateFilter();
+    explicit DuplicateFilter(const Options& options);
+
+    /**
+     * @brief Check if package was seen during time window and remember it
+     * @return true if package is a duplicate
+     */
+    bool check_update(uint64_t source_addr, uint16_t package_id, std::chrono::steady_clock::time_point now);
+
+    size_t size() const;
+    size_t capacity() const;
+
+private:
+    struct Key
+    {
+        uint64_t source_addr = 0;
+        uint16_t package_id = 0;
+
+        bool operator==(const Key& other) const
+        {
+            return source_addr == other.source_addr && package_id == other.package_id;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            return size_t(key.source_addr * 0xFF51AFD7ED558CCDull) ^ key.package_id;
+        }
+    };
+
+    using Table = LruHashTable<Key, std::chrono::steady_clock::time_point, KeyHash>;
+
+    /// Rebuild table with given capacity, packages seen earlier than window ago are not copied
+    void resize(size_t capacity, std::chrono::steady_clock::time_point now);
+
+    Options m_options;
+    Table m_table;
+    std::chrono::steady_clock::time_point m_window_begin{};
+    /// New packages since m_window_begin
+    size_t m_window_inserts = 0;
+};
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <optional>
+
+#include <cstdint>
+#include <cstdlib>
+
+namespace ntdcp
+{
+
+/**
+ * @brief The ReedSolomon class is a systematic Reed-Solomon code over GF(256).
+ * Data is split into blocks of block_size - parity_size bytes and every block is followed by
+ * parity_size bytes of parity. The last block is shortened. Every block may be repaired
+ * if it has not more than parity_size / 2 corrupted bytes
+ */
+class ReedSolomon
+{
+public:
+    constexpr static size_t block_size = 255;
+
+    /**
+     * @param parity_size  Parity bytes per block, 0 means no FEC. Should be less than block_size
+     */
+    explicit ReedSolomon(size_t parity_size = 0);
+
+    size_t parity_size() const;
+    size_t data_block_size() const;
+
+    size_t encoded_size(size_t data_size) const;
+
+    /**
+     * @brief Encode data by blocks
+     * @param output  Memory for encoded_size(size) bytes
+     */
+    void encode(const uint8_t* data, size_t size, uint8_t* output) const;
+
+    /**
+     * @brief Repair encoded data in place and remove parity bytes
+     * @return Size of data left at the beginning or nothing if data cannot be repaired
+     */
+    std::optional<size_t> decode(uint8_t* data, size_t size) const;
+
+    void encode_block(const uint8_t* data, size_t size, uint8_t* parity) const;
+
+    /**
+     * @brief Repair single block in place
+     * @param block  Data with parity_size parity bytes at the end, size <= block_size
+     * @return false if block has too many errors
+     */
+    bool correct_block(uint8_t* block, size_t size) const;
+
+private:
+    size_t m_parity_size;
+    /// Generator polynomial, highest power first
+    uint8_t m_generator[block_size + 1];
+};
+
+}
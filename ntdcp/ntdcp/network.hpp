@@ -2,7 +2,11 @@
 
 #include "ntdcp/channel.hpp"
 #include "ntdcp/system-driver.hpp"
-#include "ntdcp/caching-set.hpp"
+#include "ntdcp/duplicate-filter.hpp"
+#include "ntdcp/routing.hpp"
+#include "ntdcp/relay-election.hpp"
+#include "ntdcp/tx-scheduler.hpp"
+#include "ntdcp/worker-pool.hpp"
 
 #include <map>
 #include <queue>
@@ -33,6 +37,13 @@ namespace ntdcp
  * 7,6,5,4: hop limit
  *   - if from 0b000 to 0b110 it is a value of hop limit
  *   - if 0b111 then next byte after adresses is hop limit
+ *
+ * Aggregated frame contents when PhysicalInterfaceOptions::aggregation is on
+ *
+ * | count: 1 byte | count x package size: 2 bytes | package 1 | ... | package count |
+ *
+ * Packages to RoutingTable::advertisement_addr and RelayElection::hello_addr are link-local
+ * control messages of neighbours, they are not delivered to incoming() and not retransmitted
  */
 
 class NetworkLayer : public PtrAliases<NetworkLayer>
@@ -45,13 +56,51 @@ public:
         Buffer::ptr data;
     };
     
+    enum class SendStatus
+    {
+        /// Package is queued
+        queued,
+        /// Package is queued, but transmit queue is standing and sender should slow down
+        congested,
+        /// Transmit queues are full, package is dropped
+        dropped
+    };
+
+    struct Options
+    {
+        /// Additional threads that decode incoming data of different interfaces concurrently.
+        /// 0 means that everything is done in the thread that calls serve()
+        size_t rx_worker_threads = 0;
+        /// Packages from the same source with the same id are dropped during the window
+        DuplicateFilter::Options duplicate_filter;
+        /// Unicast packages to destinations learned from incoming traffic are not flooded
+        RoutingTable::Options routing;
+        /// Floods are retransmitted only by nodes of connected dominating set when HELLOs are on
+        RelayElection::Options relay_election;
+        /// Transmit queue of every interface: size limit, CoDel and traffic classes scheduling
+        TxScheduler::Options tx_queue;
+    };
+
     NetworkLayer(SystemDriver::ptr sys, uint64_t addr);
+    NetworkLayer(SystemDriver::ptr sys, uint64_t addr, const Options& options);
     void add_physical(IPhysicalInterface::ptr phys);
 
-    void send(Buffer::ptr data, uint64_t destination_addr, uint8_t hop_limit = 10);
-    void send(SegmentBuffer data, uint64_t destination_addr, uint8_t hop_limit = 10);
+    constexpr static uint8_t default_hop_limit = 10;
+
+    SendStatus send(Buffer::ptr data, uint64_t destination_addr, uint8_t hop_limit = default_hop_limit,
+                    TrafficClass traffic_class = TrafficClass::bulk);
+    SendStatus send(SegmentBuffer data, uint64_t destination_addr, uint8_t hop_limit = default_hop_limit,
+                    TrafficClass traffic_class = TrafficClass::bulk);
     std::optional<Package> incoming();
 
+    /**
+     * @brief Check if packages of the traffic class would be delayed: any transmit queue is full
+     * or the oldest package of the class waits longer than CoDel target. Packages of other
+     * classes are not taken into account, so forwarded traffic that waits for its DRR turn
+     * does not stall own one
+     */
+    bool congested(TrafficClass traffic_class = TrafficClass::bulk) const;
+
     void serve();
     
     SystemDriver::ptr system_driver();
@@ -66,8 +115,10 @@ private:
     };
 
     void serve_incoming();
+    void serve_routing();
     void serve_outgoing();
-    void retransmit(const PackageHeader& pkg, Buffer::ptr data, IPhysicalInterface::ptr came_from);
+    /// Encode package to neighbours that is not retransmitted
+    SegmentBuffer make_link_local(Buffer::ptr data, uint64_t destination_addr);
     bool address_acceptable(uint64_t addr);
 
     uint16_t random_id();
@@ -80,21 +131,57 @@ private:
         constexpr static uint8_t bytes_4 = 0b11;
     };
 
-    static std::optional<std::pair<PackageHeader, Buffer::ptr>> decode(const MemBlock& data);
+    static std::optional<std::pair<PackageHeader, Buffer::ptr>> decode(const Buffer::ptr& frame);
     static void encode(PackageHeader package, SegmentBuffer& buf);
 
     static uint8_t get_addr_size_bits(uint64_t addr);
-    static void put_address_to_buffer(Buffer::ptr buf, uint64_t addr);
+    static uint8_t* write_address(uint8_t* dst, uint64_t addr, uint8_t address_size_bits);
     static std::optional<uint64_t> read_addr_from_mem(MemBlock& data, uint8_t address_size_bits);
 
-    ChannelLayer m_channel;
     SystemDriver::ptr m_sys;
     uint64_t m_addr;
 
     std::queue<Package> m_incoming;
-    std::map<IPhysicalInterface::ptr, std::queue<Buffer::ptr>> m_outgoing;
-    std::list<IPhysicalInterface::ptr> m_phys_devices;
-    CachingSet<uint16_t> m_packages_already_received{100};
+
+    struct Interface
+    {
+        Interface(IPhysicalInterface::ptr phys, const TxScheduler::Options& tx_queue);
+
+        IPhysicalInterface::ptr phys;
+        /// Codec is selected per interface and decoder keeps stream state
+        ChannelLayer channel;
+        /// Network packages without channel layer encoding
+        TxScheduler outgoing;
+        /// Packages decoded during current serve_incoming() call
+        std::vector<std::pair<PackageHeader, Buffer::ptr>> received;
+    };
+
+    void decode_incoming(Interface& interface);
+    void decode_package(Interface& interface, const Buffer::ptr& data);
+    /**
+     * @param replaceable  Link-local package that is superseded by the next one, see TxScheduler::push()
+     * @return false if queue is full and package is dropped
+     */
+    bool enqueue(Interface& interface, const SegmentBuffer& package, TrafficClass traffic_class, bool replaceable = false);
+    bool congested(const Interface& interface, TrafficClass traffic_class) const;
+    /**
+     * @brief Enqueue package to the interface of known route or to all interfaces
+     * @param came_from  Interface package was received from or nullptr for own packages
+     */
+    SendStatus route(const SegmentBuffer& package, uint64_t destination_addr, const Interface* came_from, TrafficClass traffic_class);
+    void retransmit(const PackageHeader& pkg, Buffer::ptr data, const Interface& came_from);
+    void send_next_frame(Interface& interface);
+    /// @return true if aggregated frame should be sent now
+    bool aggregation_ready(const Interface& interface) const;
+
+    Options m_options;
+    std::vector<std::unique_ptr<Interface>> m_interfaces;
+    std::unique_ptr<WorkerPool> m_rx_workers;
+    DuplicateFilter m_packages_already_received;
+    RoutingTable m_routing;
+    std::optional<std::chrono::steady_clock::time_point> m_last_advertisement;
+    RelayElection m_relay_election;
+    std::optional<std::chrono::steady_clock::time_point> m_last_hello;
 };
 
 }
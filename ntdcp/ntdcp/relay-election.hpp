@@ -0,0 +1,77 @@
+#pragma once
+
+#include "ntdcp/utils.hpp"
+
+#include <chrono>
+#include <map>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+
+namespace ntdcp
+{
+
+/**
+ * @brief The RelayElection class decides if node should retransmit floods, so that only nodes
+ * of connected dominating set do it (Wu-Li marking process with pruning rules 1 and 2).
+ *
+ * Nodes periodically send HELLO with list of 1-hop neighbours to link-local address hello_addr,
+ * so every node knows its 2-hop neighbourhood. Node is marked if it has two neighbours that are
+ * not connected directly. Marked node is unmarked if its neighbourhood is covered by one marked
+ * neighbour with bigger address (rule 1) or by two connected marked neighbours with bigger
+ * addresses (rule 2).
+ *
+ * Node without known neighbours is a relay, so floods are never lost before HELLOs are exchanged
+ *
+ * HELLO contents
+ *
+ * | flags: 1 byte, bit 0 means marked | count: 1 byte | count x address: 4 bytes |
+ */
+class RelayElection
+{
+public:
+    constexpr static uint64_t hello_addr = 0xFD;
+
+    struct Options
+    {
+        /// Period of HELLO messages, 0 means that every node retransmits floods
+        std::chrono::milliseconds hello_period{0};
+        /// Neighbour is forgotten if its HELLO was not heard during this time
+        std::chrono::milliseconds neighbour_timeout{5000};
+    };
+
+    explicit RelayElection(uint64_t own_addr);
+    RelayElection(uint64_t own_addr, const Options& options);
+
+    const Options& options() const;
+
+    Buffer::ptr make_hello(std::chrono::steady_clock::time_point now);
+    void process_hello(uint64_t source_addr, const Buffer::ptr& hello, std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Check if this node should retransmit floods
+     */
+    bool is_relay(std::chrono::steady_clock::time_point now);
+
+private:
+    struct Neighbour
+    {
+        std::vector<uint64_t> neighbours;
+        bool marked = false;
+        std::chrono::steady_clock::time_point updated;
+
+        bool connected_to(uint64_t addr) const;
+    };
+
+    void forget_old(std::chrono::steady_clock::time_point now);
+    bool marked() const;
+    bool pruned() const;
+    /// @return true if every own neighbour is one of nodes or is connected to one of them
+    bool covered_by(const Neighbour* first, uint64_t first_addr, const Neighbour* second, uint64_t second_addr) const;
+
+    uint64_t m_addr;
+    Options m_options;
+    std::map<uint64_t, Neighbour> m_neighbours;
+};
+
+}
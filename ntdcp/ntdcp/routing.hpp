@@ -0,0 +1,127 @@
+#pragma once
+
+#include "ntdcp/caching-set.hpp"
+#include "ntdcp/utils.hpp"
+
+#include <chrono>
+#include <limits>
+#include <optional>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+
+namespace ntdcp
+{
+
+/**
+ * @brief The RoutingTable class keeps a route to every known destination.
+ *
+ * Routes are learned from incoming traffic (reverse path learning): if package from some
+ * source came through an interface, packages to that source should be sent through the same
+ * interface. Among copies of the same package the one with bigger hop limit left passed fewer
+ * relays, so its interface is preferred. Hop limits of different packages are not compared,
+ * because every sender chooses its own initial hop limit, so the first copy of a new package
+ * sets the route.
+ *
+ * When advertisement_period is not zero nodes also exchange distance vectors to link-local
+ * address advertisement_addr. Advertised route has cumulative link cost and hops count, it is
+ * chosen by the least cost and is preferred to learned one. Every entry carries the next hop
+ * of the advertiser, so the neighbour that is the next hop ignores it (poisoned reverse keyed
+ * by neighbour). It works on shared media where all neighbours are behind one interface.
+ *
+ * Route is an interface, not a next hop, so on a shared medium it only limits hop limit,
+ * and every neighbour that knows the destination relays the package
+ *
+ * Routes that were not confirmed for route_timeout are forgotten and packages are flooded again
+ *
+ * Advertisement contents
+ *
+ * | count: 1 byte | count x (address: 4 bytes, cost: 2 bytes, hops: 1 byte, next hop: 4 bytes) |
+ */
+class RoutingTable
+{
+public:
+    constexpr static uint64_t advertisement_addr = 0xFE;
+    constexpr static uint16_t unreachable_cost = 0xFFFF;
+
+    struct Options
+    {
+        /// Learn routes and send unicast packages through one interface. Otherwise always flood
+        bool enabled = true;
+        std::chrono::milliseconds route_timeout{30000};
+        /// Maximal count of remembered destinations, least recently used are forgotten
+        size_t capacity = 256;
+        /// Period of distance vector advertisements, 0 means passive learning only.
+        /// Should be several times less than route_timeout
+        std::chrono::milliseconds advertisement_period{0};
+        /// Hop limit of own package with advertised route is hops - 1 + hop_limit_margin
+        uint8_t hop_limit_margin = 1;
+    };
+
+    struct Route
+    {
+        /// Index of interface in NetworkLayer
+        size_t interface = 0;
+        /// Hop limit left in the last package that confirmed the route
+        uint8_t hop_limit_left = 0;
+        /// Id of the last package that confirmed the route, only its copies are compared
+        uint16_t package_id = 0;
+        /// Cumulative link cost, unreachable_cost for routes learned from traffic
+        uint16_t cost = unreachable_cost;
+        /// Hops to destination, known only for advertised routes
+        uint8_t hops = 0;
+        /// Neighbour that advertised the route, known only for advertised routes
+        uint64_t next_hop = 0;
+        std::chrono::steady_clock::time_point updated;
+
+        bool advertised() const;
+    };
+
+    RoutingTable();
+    explicit RoutingTable(const Options& options);
+
+    const Options& options() const;
+
+    /**
+     * @brief Learn route to source of incoming package
+     */
+    void learn(uint64_t source_addr, uint16_t package_id, size_t interface, uint8_t hop_limit_left,
+               std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Find route to destination
+     * @return Route or nothing if package should be flooded
+     */
+    std::optional<Route> find(uint64_t destination_addr, std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Hop limit enough to reach destination by advertised route
+     */
+    uint8_t hop_limit(uint64_t destination_addr, uint8_t requested, std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Build advertisements of all advertised routes
+     * @param own_addr  Address of this node that is advertised with zero cost
+     * @param max_size  Routes are split to several advertisements not bigger than max_size bytes
+     */
+    std::vector<Buffer::ptr> make_advertisements(uint64_t own_addr, std::chrono::steady_clock::time_point now,
+                                                 size_t max_size = std::numeric_limits<size_t>::max());
+
+    /**
+     * @brief Update routes with advertisement of neighbour
+     * @param own_addr        Routes to this node and routes through it are ignored
+     * @param neighbour_addr  Source of advertisement
+     * @param link_cost       Cost of the link advertisement came through
+     */
+    void process_advertisement(const Buffer::ptr& advertisement, uint64_t own_addr, uint64_t neighbour_addr,
+                               size_t interface, uint16_t link_cost, std::chrono::steady_clock::time_point now);
+
+private:
+    void advertised(uint64_t destination_addr, const Route& candidate, std::chrono::steady_clock::time_point now);
+    bool expired(const Route& route, std::chrono::steady_clock::time_point now) const;
+
+    Options m_options;
+    CachingMap<uint64_t, Route> m_routes;
+};
+
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ntdcp/utils.hpp"
+#include "ntdcp/channel.hpp"
 #include <chrono>
 #include <cstdint>
 
@@ -37,13 +38,42 @@ struct PhysicalInterfaceOptions
     std::chrono::milliseconds tx_time{0};
     bool retransmit_back = false;
     int ring_buffer_size = 1024;
+    /// Channel layer codec used on this interface
+    ChannelLayer::Options channel;
+
+    /// Link never loses or corrupts data and keeps stream in sync, like shared memory or UNIX socket.
+    /// Frames are only prefixed by length, without magic search and checksum
+    bool reliable_framing = false;
+    /// Link drops corrupted data itself, so software checksum is not calculated
+    bool hardware_crc = false;
+    /// Cost of sending through this link for distance vector routing, for example airtime
+    uint16_t link_cost = 1;
+
+    /// Pack several network packages into one frame. Both sides of the link should use the same mode
+    bool aggregation = false;
+    /// Time to wait for more packages before sending not full aggregated frame
+    std::chrono::milliseconds aggregation_hold_time{0};
+    /// Maximal size of aggregated frame contents. Bigger packages are sent alone
+    size_t aggregation_max_size = 256;
+
+    /**
+     * @brief Channel options adjusted to the link capabilities
+     */
+    ChannelLayer::Options channel_options() const;
 };
 
 class IPhysicalInterface : public PtrAliases<IPhysicalInterface>
 {
 public:
+    virtual ~IPhysicalInterface() = default;
     virtual SerialReadAccessor& incoming() = 0;
     virtual void send(Buffer::ptr data) = 0;
+    /**
+     * @brief Send data gathered from several segments. Default implementation
+     * concatenates segments, interfaces able to transmit segments one by one
+     * should override it
+     */
+    virtual void send(const SegmentBuffer& data);
     virtual bool busy() const = 0;
     virtual const PhysicalInterfaceOptions& options() const = 0;
 };
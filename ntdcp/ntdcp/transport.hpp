@@ -88,6 +88,9 @@ public:
         std::chrono::milliseconds restransmission_time{1000};
 
         std::chrono::milliseconds force_ack_after{200};
+
+        /// Traffic class of data messages. Acknowledgements and connection control are always control
+        TrafficClass traffic_class = TrafficClass::bulk;
     };
 
     SocketBase(TransportLayer& transport_layer, uint64_t remote_address, uint16_t local_port, uint16_t remote_port, const Options& opts); // mb replace connecion id with addr, port, port?
@@ -99,8 +102,17 @@ public:
 
     ConnectionId incoming_connectiion_id();
 
+    /// Traffic class of data messages
+    TrafficClass traffic_class() const;
+    TrafficClass traffic_class(const TransportDescription& header) const;
+
     virtual void receive(Buffer::ptr data, const TransportDescription& header) = 0;
-    virtual std::optional<std::pair<TransportDescription, SegmentBuffer>> pick_outgoing() = 0;
+    /**
+     * @brief Pick the next message to be sent
+     * @param data_allowed  Data messages may be picked. Otherwise only acknowledgements
+     *                      and connection control are picked, for example when network is congested
+     */
+    virtual std::optional<std::pair<TransportDescription, SegmentBuffer>> pick_outgoing(bool data_allowed = true) = 0;
 
 protected:
     TransportLayer& m_transport_layer;
@@ -144,7 +156,7 @@ public:
     uint16_t missed_from_remote();
 
     void receive(Buffer::ptr data, const TransportDescription& header) override;
-    std::optional<std::pair<TransportDescription, SegmentBuffer>> pick_outgoing() override;
+    std::optional<std::pair<TransportDescription, SegmentBuffer>> pick_outgoing(bool data_allowed = true) override;
 
 private:
     struct AckTask
@@ -190,7 +202,7 @@ public:
     ~Acceptor();
 
     void receive(Buffer::ptr data, const TransportDescription& header) override;
-    std::optional<std::pair<TransportDescription, SegmentBuffer>> pick_outgoing() override;
+    std::optional<std::pair<TransportDescription, SegmentBuffer>> pick_outgoing(bool data_allowed = true) override;
 
 private:
     OnNewConnectionCallback m_on_new_connection;
@@ -211,7 +223,7 @@ public:
 
     SystemDriver::ptr system_driver();
 
-    static std::optional<std::pair<TransportDescription, Buffer::ptr>> decode(MemBlock mem);
+    static std::optional<std::pair<TransportDescription, Buffer::ptr>> decode(const Buffer::ptr& package);
     static void encode(SegmentBuffer& seg_buf, const TransportDescription& header);
 
 private:
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "ntdcp/utils.hpp"
+#include "ntdcp/codel.hpp"
+
+#include <array>
+#include <chrono>
+#include <deque>
+#include <optional>
+#include <cstdint>
+#include <cstdlib>
+
+namespace ntdcp
+{
+
+enum class TrafficClass
+{
+    /// Acknowledgements, connection and routing control. Always sent first
+    control = 0,
+    interactive,
+    bulk,
+    /// Packages of other nodes retransmitted by this one
+    forwarded
+};
+
+/**
+ * @brief The TxScheduler class is a transmit queue of interface with a queue per traffic class.
+ * Control class has strict priority, other classes share the link by deficit round robin with
+ * weighted quantums. Every class queue has its own CoDel, stale packages are dropped when
+ * they are going to be sent.
+ *
+ * Usage: peek() selects the next package, pop() takes the selected one
+ */
+class TxScheduler
+{
+public:
+    struct Options
+    {
+        /// Maximal count of packages except control ones, new packages are dropped above it
+        size_t limit = 128;
+        /// Maximal count of control packages. Above it new control package replaces the oldest
+        /// replaceable one, because stale HELLOs and advertisements are superseded by new ones.
+        /// If there is no such package, new one is dropped
+        size_t control_limit = 16;
+        /// Active queue management of every class queue
+        CoDel::Options codel;
+        /// Bytes added to class deficit every round is quantum * weight of the class
+        size_t quantum = 128;
+        size_t interactive_weight = 4;
+        size_t bulk_weight = 2;
+        size_t forwarded_weight = 1;
+    };
+
+    TxScheduler();
+    explicit TxScheduler(const Options& options);
+
+    const Options& options() const;
+
+    /**
+     * @param replaceable  Package is superseded by the next one of the same kind, like HELLO,
+     *                     so it may be dropped for a new control package
+     * @return false if queue is full and package is dropped
+     */
+    bool push(TrafficClass traffic_class, const SegmentBuffer& package, std::chrono::steady_clock::time_point now,
+              bool replaceable = false);
+
+    /**
+     * @brief Select the next package to be sent
+     * @return Package that will be returned by pop() or nullptr if queue is empty
+     */
+    const SegmentBuffer* peek(std::chrono::steady_clock::time_point now);
+    SegmentBuffer pop();
+
+    bool empty() const;
+    bool full() const;
+    /// Count of packages
+    size_t size() const;
+    /// Size of all packages in bytes
+    size_t bytes() const;
+    /// Time when the oldest package was queued
+    std::optional<std::chrono::steady_clock::time_point> oldest() const;
+    /// Time when the oldest package of the class was queued
+    std::optional<std::chrono::steady_clock::time_point> oldest(TrafficClass traffic_class) const;
+
+private:
+    constexpr static size_t classes_count = 4;
+
+    struct Item
+    {
+        SegmentBuffer package;
+        std::chrono::steady_clock::time_point queued;
+        bool replaceable = false;
+    };
+
+    struct ClassQueue
+    {
+        std::deque<Item> items;
+        CoDel codel;
+        size_t deficit = 0;
+    };
+
+    std::optional<size_t> select();
+    size_t quantum(size_t index) const;
+    /// Remove head package, its size should be already subtracted from m_bytes
+    void remove_head(size_t index);
+
+    Options m_options;
+    std::array<ClassQueue, classes_count> m_queues;
+    size_t m_size = 0;
+    size_t m_bytes = 0;
+
+    /// Class that is visited by round robin now
+    size_t m_current = size_t(TrafficClass::interactive);
+    bool m_quantum_added = false;
+    std::optional<size_t> m_selected;
+};
+
+}
@@ -4,6 +4,7 @@
 #include <list>
 #include <limits>
 #include <memory>
+#include <atomic>
 
 #include <cstdint>
 #include <cstdlib>
@@ -14,6 +15,7 @@ namespace ntdcp
 
 class Buffer;
 class RingBuffer;
+struct MemSpans;
 
 template<typename T>
 class PtrAliases
@@ -39,8 +41,29 @@ public:
     virtual size_t size() const = 0;
     virtual uint8_t operator[](size_t pos) const = 0;
 
+    /**
+     * @brief Get direct access to the stored data without copying
+     * @param offset  Offset of the first byte
+     * @param size    Bytes count, it is truncated if there is not enough data
+     * @return Not more than two contiguous memory blocks, the second one is used
+     *         if data is not contiguous, like in RingBuffer when wrapping around
+     */
+    virtual MemSpans peek_spans(size_t offset, size_t size) const = 0;
+
     virtual bool empty() const;
     virtual void extract(uint8_t* buf, size_t size);
+    /**
+     * @brief Maximal count of bytes that may be stored at once. When size() reaches it,
+     * no more data will come until something is skipped
+     * @return SIZE_MAX if not limited
+     */
+    virtual size_t capacity() const;
+
+    /**
+     * @brief Copy data from the given offset without skipping it
+     * @return false if there is not enough data
+     */
+    bool peek(size_t offset, void* buf, size_t size) const;
 
     std::shared_ptr<Buffer> extract_buf(size_t extraction_size);
     std::shared_ptr<Buffer> extract_buf();
@@ -49,10 +72,7 @@ public:
     T as(size_t pos)
     {
         T result;
-        for (size_t i = 0; i < sizeof(T); i++)
-        {
-            reinterpret_cast<uint8_t*>(&result)[i] = (*this)[pos + i];
-        }
+        peek(pos, &result, sizeof(T));
         return result;
     }
 
@@ -85,6 +105,7 @@ public:
     bool get(uint8_t* buf, size_t size) const override;
     size_t size() const override;
     uint8_t operator[](size_t pos) const override;
+    MemSpans peek_spans(size_t offset, size_t size) const override;
 
     MemBlock offset(size_t off) const;
 
@@ -112,6 +133,38 @@ private:
     const uint8_t* m_end;
 };
 
+struct MemSpans
+{
+    MemBlock first;
+    MemBlock second;
+
+    size_t size() const;
+};
+
+/**
+ * @brief The WriteSpans struct is a writable memory reserved in a ring buffer. Like MemSpans
+ * it has two blocks, the second one is used when reserved space wraps around
+ */
+struct WriteSpans
+{
+    struct Block
+    {
+        uint8_t* data = nullptr;
+        size_t size = 0;
+    };
+
+    Block first;
+    Block second;
+
+    size_t size() const;
+
+    /**
+     * @brief Copy data to reserved memory
+     * @return false if data does not fit
+     */
+    bool write(size_t offset, const void* src, size_t size);
+};
+
 
 /**
  * @brief The SerialWriteAccessor class represents something seriallu writable
@@ -181,6 +234,9 @@ private:
  */
 class Buffer : public SerialWriteAccessor, public PtrAliases<Buffer>
 {
+private:
+    struct PrivateTag {};
+
 public:
     using ptr = std::shared_ptr<Buffer>;
 
@@ -190,6 +246,22 @@ public:
     static ptr create(const MemBlock& data);
     static ptr create_from_string(const char* str);
 
+    /**
+     * @brief Create buffer with reserved space before contents, so headers may be
+     * prepended later without new allocation
+     */
+    static ptr create_with_headroom(size_t headroom, size_t size = 0, const void* init_data = nullptr);
+
+    /**
+     * @brief Create a view to the part of parent's contents without copying. Slice keeps
+     * parent alive, writing to slice modifies parent. Parent must not be resized while slices
+     * exist. Slice gets its own memory (copy) only when it is extended or prepended
+     */
+    static ptr slice(const ptr& parent, size_t offset, size_t size = std::numeric_limits<size_t>::max());
+
+    /// Headroom that is enough for channel, network and transport headers together
+    constexpr static size_t default_headroom = 64;
+
     template<typename T>
     static ptr serialize(const T& data)
     {
@@ -202,6 +274,20 @@ public:
 
     MemBlock contents() const;
 
+    /**
+     * @brief Grow buffer to the front. Uses headroom if it is enough, otherwise reallocates
+     * @return pointer to the new beginning of the contents
+     */
+    uint8_t* prepend(size_t size);
+    size_t headroom() const;
+
+    /**
+     * @brief Grow buffer to the back without initialization of new contents.
+     * Capacity grows at least twice when reallocation is needed
+     * @return pointer to the appended part
+     */
+    uint8_t* append(size_t size);
+
     ptr clone() const;
 
     size_t size() const;
@@ -215,11 +301,34 @@ public:
 
     bool operator==(const Buffer& right) const;
 
+    /**
+     * @brief Only for std::allocate_shared, use Buffer::create instead
+     */
+    Buffer(PrivateTag, uint8_t* storage, size_t capacity);
+    ~Buffer();
+
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+
 private:
-    Buffer(size_t size = 0, const void* init_data = nullptr);
-    void extend(size_t size);
+    /**
+     * @brief Create empty buffer with at least given capacity. Control block, buffer object
+     * and contents are placed into the same BufferPool block when it is possible
+     */
+    static ptr allocate(size_t capacity, size_t headroom);
 
-    std::vector<uint8_t> m_contents;
+    void extend(size_t size);
+    void reallocate(size_t headroom, size_t capacity);
+
+    uint8_t* m_storage = nullptr;
+    size_t m_capacity = 0;
+    /// Offset of contents from the storage beginning, free space before it is a headroom
+    size_t m_head = 0;
+    size_t m_size = 0;
+    /// Storage is a separate pool block and not a tail of buffer's own block
+    bool m_storage_detached = false;
+    /// Buffer that owns storage when this buffer is a slice
+    std::shared_ptr<const Buffer> m_parent;
 };
 
 /**
@@ -231,6 +340,7 @@ class RingBuffer : public SerialReadAccessor, public SerialWriteAccessor
 public:
     RingBuffer(size_t capacity);
 
+    size_t capacity() const override;
     size_t free_space();
     /**
      * @brief Get size of currently stored not readed data
@@ -243,6 +353,17 @@ public:
     bool put(Buffer::ptr buf);
     bool will_fit(size_t size) override;
 
+    /**
+     * @brief Get writable memory for size bytes to fill it directly, without intermediate buffer.
+     * Data become readable only after commit()
+     * @return Reserved memory or empty spans if there is not enough free space
+     */
+    WriteSpans reserve(size_t size);
+    /**
+     * @brief Make size bytes written to reserved memory readable
+     */
+    void commit(size_t size);
+
     bool get(uint8_t* buf, size_t size) const override;
     void extract(uint8_t* buf, size_t size) override;
     void skip(size_t size) override;
@@ -260,36 +381,127 @@ public:
 
     uint8_t operator[](size_t pos) const override;
     uint8_t& operator[](size_t pos);
+    MemSpans peek_spans(size_t offset, size_t size) const override;
 
 private:
     std::vector<uint8_t> m_contents;
     uint32_t m_p_write = 0, m_p_read = 0;
 };
 
+/**
+ * @brief The SpscRingBuffer class is a lock-free ring buffer for exactly one producer thread
+ * (e.g. UART or radio driver) and one consumer thread (network layer). Capacity is rounded up
+ * to the power of two.
+ *
+ * Producer may call only put(), will_fit() and free_space(), all other methods are for consumer.
+ */
+class SpscRingBuffer : public SerialReadAccessor, public SerialWriteAccessor
+{
+public:
+    explicit SpscRingBuffer(size_t capacity);
+
+    size_t capacity() const override;
+    size_t free_space() const;
+    size_t size() const override;
+
+    bool put(const void* src, size_t size) override;
+    bool put(SerialReadAccessor& accessor, size_t size) override;
+    bool will_fit(size_t size) override;
+
+    /**
+     * @brief The same as RingBuffer::reserve, for producer thread
+     */
+    WriteSpans reserve(size_t size);
+    /**
+     * @brief Publish data to consumer thread
+     */
+    void commit(size_t size);
+
+    bool get(uint8_t* buf, size_t size) const override;
+    void skip(size_t size) override;
+    bool empty() const override;
+
+    uint8_t operator[](size_t pos) const override;
+    MemSpans peek_spans(size_t offset, size_t size) const override;
+
+private:
+    std::vector<uint8_t> m_contents;
+    uint32_t m_mask;
+
+    // Positions are never wrapped, only masked, so size is just a difference.
+    // They are on different cache lines to prevent false sharing between threads
+    alignas(64) std::atomic<uint32_t> m_write{0};
+    alignas(64) std::atomic<uint32_t> m_read{0};
+};
+
 /**
  * @brief The SegmentBuffer class designed to concatenate different buffers.
- * It owns buffers storing it's shared_ptrs
+ * It owns buffers storing it's shared_ptrs. First inline_segments segments are stored
+ * inside the object, so typical packet does not need heap for bookkeeping.
+ *
+ * Total size is tracked when segments are added, so segment buffers must not be
+ * resized by anybody else while they are in SegmentBuffer
  */
 class SegmentBuffer
 {
 public:
+    constexpr static size_t inline_segments = 4;
+
+    class Segments
+    {
+    public:
+        Segments(const Buffer::ptr* begin, size_t size) :
+            m_begin(begin), m_size(size)
+        {}
+
+        const Buffer::ptr* begin() const { return m_begin; }
+        const Buffer::ptr* end() const { return m_begin + m_size; }
+        size_t size() const { return m_size; }
+
+    private:
+        const Buffer::ptr* m_begin;
+        size_t m_size;
+    };
+
     explicit SegmentBuffer(Buffer::ptr buf = nullptr);
+    SegmentBuffer(const SegmentBuffer& other);
+    SegmentBuffer(SegmentBuffer&& other) noexcept;
+
+    SegmentBuffer& operator=(const SegmentBuffer& other);
+    SegmentBuffer& operator=(SegmentBuffer&& other) noexcept;
+
     void push_front(Buffer::ptr buf);
     void push_back(Buffer::ptr buf);
 
-    void push_front(SegmentBuffer& buf);
-    void push_back(SegmentBuffer& buf);
+    void push_front(const SegmentBuffer& buf);
+    void push_back(const SegmentBuffer& buf);
+
+    /**
+     * @brief Get place for a header of given size before all segments. Header is written
+     * in place to the front buffer's headroom when the buffer is not shared with anybody,
+     * otherwise new front buffer with headroom for next headers is added
+     * @return pointer to the memory for the header
+     */
+    uint8_t* prepend(size_t size);
 
     Buffer::ptr merge();
     bool empty() const;
     size_t size() const;
     void clear();
 
-    const std::list<Buffer::ptr>& segments();
+    Segments segments() const;
 
 private:
-
-    std::list<Buffer::ptr> m_segments;
+    Buffer::ptr* data();
+    const Buffer::ptr* data() const;
+    bool spilled() const;
+    void spill();
+
+    Buffer::ptr m_inline[inline_segments];
+    /// Used instead of m_inline when segments count exceeds inline_segments
+    std::vector<Buffer::ptr> m_spilled;
+    size_t m_count = 0;
+    size_t m_total_size = 0;
 };
 
 /**
@@ -326,4 +538,34 @@ private:
 uint32_t hash_Ly(uint8_t next_byte, uint32_t prev_hash);
 uint32_t hash_Ly(const void * buf, uint32_t size, uint32_t hash = 0);
 
+/**
+ * @brief Find first position of little endian 16-bit value in memory. Uses AVX2 or SSE2 when available
+ *        and portable SWAR code otherwise
+ * @return Position of value's low byte or size if value was not found
+ */
+size_t find_u16(const uint8_t* data, size_t size, uint16_t value);
+
+/**
+ * @brief Find all positions of little endian 16-bit value in memory, including overlapping ones
+ * @param positions  Found positions are appended here
+ */
+void find_all_u16(const uint8_t* data, size_t size, uint16_t value, std::vector<size_t>& positions);
+
+/**
+ * Implementations of find_u16 for different instruction sets, find_u16 selects one of them at runtime.
+ * SSE2 and AVX2 ones may be called only when supported, on other architectures they fall back to SWAR
+ */
+namespace find_u16_impl
+{
+
+size_t scalar(const uint8_t* data, size_t size, uint16_t value);
+size_t swar(const uint8_t* data, size_t size, uint16_t value);
+size_t sse2(const uint8_t* data, size_t size, uint16_t value);
+size_t avx2(const uint8_t* data, size_t size, uint16_t value);
+
+bool sse2_supported();
+bool avx2_supported();
+
+}
+
 }
@@ -37,10 +37,11 @@ public:
 
     SerialReadAccessor& incoming() override;
     void send(Buffer::ptr data) override;
+    void send(const SegmentBuffer& data) override;
     bool busy() const override;
     const PhysicalInterfaceOptions& options() const override;
 
-    void receive_from_medium(Buffer::ptr data);
+    void receive_from_medium(const SegmentBuffer& data);
 
 private:
     VirtualPhysicalInterface(PhysicalInterfaceOptions opts, SystemDriver::ptr sys, std::shared_ptr<TransmissionMedium> medium);
@@ -56,7 +57,7 @@ class TransmissionMedium : public PtrAliases<TransmissionMedium>
 {
 public:
     void add_client(std::shared_ptr<VirtualPhysicalInterface> client);
-    void send(Buffer::ptr data, std::shared_ptr<VirtualPhysicalInterface> sender);
+    void send(const SegmentBuffer& data, std::shared_ptr<VirtualPhysicalInterface> sender);
     bool& broken();
 
 private:
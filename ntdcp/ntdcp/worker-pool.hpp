@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+#include <cstdint>
+#include <cstdlib>
+
+namespace ntdcp
+{
+
+/**
+ * @brief The WorkerPool class runs batches of independent tasks on a fixed set of threads.
+ * Calling thread takes part in the work, so pool with N threads uses up to N + 1 cores
+ */
+class WorkerPool
+{
+public:
+    explicit WorkerPool(size_t threads_count);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t threads_count() const;
+
+    /**
+     * @brief Call task(i) for every i in [0, count) and wait until all calls are finished.
+     * Tasks should not call run() of the same pool
+     */
+    void run(size_t count, const std::function<void(size_t)>& task);
+
+private:
+    void worker();
+    void process();
+
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_work_cv;
+    std::condition_variable m_done_cv;
+
+    const std::function<void(size_t)>* m_task = nullptr;
+    size_t m_count = 0;
+    std::atomic<size_t> m_next{0};
+    /// Workers that have not finished current batch yet
+    size_t m_busy_workers = 0;
+    uint64_t m_batch = 0;
+    bool m_stop = false;
+};
+
+}
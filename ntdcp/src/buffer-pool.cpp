@@ -0,0 +1,190 @@
+#include "ntdcp/buffer-pool.hpp"
+
+#include <mutex>
+#include <new>
+
+using namespace ntdcp;
+
+// ---------------------------
+// BufferPool::SpinLock
+
+void BufferPool::SpinLock::lock()
+{
+    while (m_flag.test_and_set(std::memory_order_acquire))
+    {
+    }
+}
+
+void BufferPool::SpinLock::unlock()
+{
+    m_flag.clear(std::memory_order_release);
+}
+
+// ---------------------------
+// BufferPool::SizeClass
+
+bool BufferPool::SizeClass::grow()
+{
+    size_t count = options.blocks_per_slab != 0 ? options.blocks_per_slab : 1;
+    if (options.max_blocks != 0)
+    {
+        if (stats.blocks_total >= options.max_blocks)
+            return false;
+        count = std::min(count, options.max_blocks - stats.blocks_total);
+    }
+
+    size_t stride = sizeof(BlockHeader) + options.block_size;
+    uint8_t* slab = reinterpret_cast<uint8_t*>(::operator new(stride * count));
+    slabs.push_back(slab);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        BlockHeader* header = new (slab + i * stride) BlockHeader;
+        header->owner = this;
+        header->next_free = free_list;
+        free_list = header;
+    }
+    stats.blocks_total += count;
+    return true;
+}
+
+// ---------------------------
+// BufferPool
+
+BufferPool& BufferPool::global()
+{
+    // Never destroyed to let static buffers outlive it
+    static BufferPool* pool = new BufferPool();
+    return *pool;
+}
+
+BufferPool::BufferPool() :
+    BufferPool(Options())
+{
+}
+
+BufferPool::BufferPool(const Options& options)
+{
+    configure(options);
+}
+
+BufferPool::~BufferPool()
+{
+    release_slabs();
+}
+
+bool BufferPool::configure(const Options& options)
+{
+    std::unique_lock<SpinLock> lck(m_lock);
+    for (const auto& size_class : m_classes)
+    {
+        if (size_class->stats.blocks_in_use != 0)
+            return false;
+    }
+
+    release_slabs();
+    m_classes.clear();
+    for (const auto& class_options : options.size_classes)
+    {
+        auto size_class = std::make_unique<SizeClass>();
+        size_class->pool = this;
+        size_class->options = class_options;
+        // Rounding to keep every block header aligned
+        constexpr size_t alignment = alignof(BlockHeader);
+        size_class->options.block_size = (class_options.block_size + alignment - 1) / alignment * alignment;
+        size_class->stats.block_size = size_class->options.block_size;
+        m_classes.push_back(std::move(size_class));
+    }
+    return true;
+}
+
+BufferPool::Block BufferPool::allocate(size_t size)
+{
+    {
+        std::unique_lock<SpinLock> lck(m_lock);
+        for (auto& size_class : m_classes)
+        {
+            if (size_class->options.block_size < size)
+                continue;
+
+            if (!size_class->free_list && !size_class->grow())
+            {
+                // Class limit is reached, predictable memory ceiling is more important here
+                size_class->stats.fallback_allocations++;
+                break;
+            }
+
+            BlockHeader* header = size_class->free_list;
+            size_class->free_list = header->next_free;
+            header->next_free = nullptr;
+
+            Statistics& stats = size_class->stats;
+            stats.blocks_in_use++;
+            if (stats.blocks_in_use > stats.high_water)
+                stats.high_water = stats.blocks_in_use;
+
+            return Block{header + 1, size_class->options.block_size};
+        }
+        if (m_classes.empty() || m_classes.back()->options.block_size < size)
+            m_oversized_allocations++;
+    }
+    return heap_allocate(size);
+}
+
+void BufferPool::deallocate(void* data)
+{
+    if (data == nullptr)
+        return;
+
+    BlockHeader* header = reinterpret_cast<BlockHeader*>(data) - 1;
+    SizeClass* owner = header->owner;
+    if (owner == nullptr)
+    {
+        header->~BlockHeader();
+        ::operator delete(header);
+        return;
+    }
+
+    std::unique_lock<SpinLock> lck(owner->pool->m_lock);
+    header->next_free = owner->free_list;
+    owner->free_list = header;
+    owner->stats.blocks_in_use--;
+}
+
+std::vector<BufferPool::Statistics> BufferPool::statistics() const
+{
+    std::unique_lock<SpinLock> lck(m_lock);
+    std::vector<Statistics> result;
+    for (const auto& size_class : m_classes)
+    {
+        result.push_back(size_class->stats);
+    }
+    return result;
+}
+
+size_t BufferPool::oversized_allocations() const
+{
+    std::unique_lock<SpinLock> lck(m_lock);
+    return m_oversized_allocations;
+}
+
+BufferPool::Block BufferPool::heap_allocate(size_t size)
+{
+    void* memory = ::operator new(sizeof(BlockHeader) + size);
+    BlockHeader* header = new (memory) BlockHeader;
+    return Block{header + 1, size};
+}
+
+void BufferPool::release_slabs()
+{
+    for (auto& size_class : m_classes)
+    {
+        for (void* slab : size_class->slabs)
+        {
+            ::operator delete(slab);
+        }
+        size_class->slabs.clear();
+        size_class->free_list = nullptr;
+        size_class->stats.blocks_total = 0;
+    }
+}
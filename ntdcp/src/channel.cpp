@@ -1,118 +1,501 @@
 #include "ntdcp/channel.hpp"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <optional>
+
 
 using namespace ntdcp;
 
-ChannelLayer::ChannelLayer()
+namespace
 {
-}
 
-Buffer::ptr ChannelLayer::find_sucessful_instance(SerialReadAccessor& accessor)
+/**
+ * Find first position in [from, limit) where magic number begins. Spans should contain
+ * at least limit + sizeof(magic) - 1 bytes
+ */
+size_t find_magic(const MemSpans& spans, uint16_t magic, size_t from, size_t limit)
 {
-    for (auto it = m_decoding_instances.begin(); it != m_decoding_instances.end();)
+    const uint8_t* first = spans.first.begin();
+    const uint8_t* second = spans.second.begin();
+    const size_t first_size = spans.first.size();
+    const size_t search_end = limit + sizeof(magic) - 1;
+
+    // Most of the time magic is inside the first block
+    if (from < first_size)
     {
-        size_t size = it->header.size;
-        if (size  + it->body_begin > accessor.size())
+        size_t end = std::min(search_end, first_size);
+        size_t found = from + find_u16(first + from, end - from, magic);
+        if (found + 1 < end)
+            return found;
+
+        // Magic may be split between blocks
+        size_t last = first_size - 1;
+        if (last < limit && spans.second.size() != 0
+            && first[last] == (magic & 0xFF) && second[0] == (magic >> 8))
         {
-            ++it;
-            continue;
+            return last;
         }
+    }
+
+    size_t second_from = std::max(from, first_size) - first_size;
+    if (search_end <= first_size || second_from >= search_end - first_size)
+        return limit;
+
+    size_t second_end = search_end - first_size;
+    size_t found = second_from + find_u16(second + second_from, second_end - second_from, magic);
+    return found + 1 < second_end ? first_size + found : limit;
+}
+
+constexpr uint8_t cobs_delimiter = 0x00;
+
+size_t cobs_max_encoded_size(size_t size)
+{
+    return size + size / 254 + 1;
+}
 
-        // Try to test
-        uint32_t hash_value = 0;
-        for (size_t i = 0; i != size; i++)
+/**
+ * COBS encoder that takes data by parts. Output should have cobs_max_encoded_size() bytes
+ */
+class CobsEncoder
+{
+public:
+    explicit CobsEncoder(uint8_t* output) :
+        m_output(output), m_code_pos(output), m_pos(output + 1)
+    {
+    }
+
+    void put(const uint8_t* data, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
         {
-            uint8_t byte = accessor[i + it->body_begin];
-            hash_value = hash_Ly(&byte, 1, hash_value);
+            if (data[i] == cobs_delimiter)
+            {
+                finish_block();
+                continue;
+            }
+
+            *m_pos++ = data[i];
+            if (++m_code == 0xFF)
+                finish_block();
         }
+    }
+
+    /// @return Encoded size
+    size_t finish()
+    {
+        *m_code_pos = m_code;
+        return m_pos - m_output;
+    }
+
+private:
+    void finish_block()
+    {
+        *m_code_pos = m_code;
+        m_code_pos = m_pos++;
+        m_code = 1;
+    }
+
+    uint8_t* m_output;
+    uint8_t* m_code_pos;
+    uint8_t* m_pos;
+    uint8_t m_code = 1;
+};
+
+/**
+ * Decode COBS data in place
+ * @return Decoded size or nothing if data is not a correct COBS sequence
+ */
+std::optional<size_t> cobs_decode(uint8_t* data, size_t size)
+{
+    size_t read = 0, write = 0;
+    while (read < size)
+    {
+        uint8_t code = data[read++];
+        if (code == cobs_delimiter || read + code - 1 > size)
+            return std::nullopt;
+
+        for (uint8_t i = 1; i < code; i++)
+            data[write++] = data[read++];
+
+        if (code != 0xFF && read < size)
+            data[write++] = cobs_delimiter;
+    }
+    return write;
+}
+
+}
+
+ChannelLayer::ChannelLayer() :
+    ChannelLayer(Options())
+{
+}
 
-        if (hash_value != it->header.checksum)
+ChannelLayer::ChannelLayer(const Options& options) :
+    m_options(options), m_checksum(options.checksum), m_fec(options.fec_parity)
+{
+    if (m_options.max_candidates == 0)
+        m_options.max_candidates = 1;
+    m_options.fec_parity = m_fec.parity_size();
+    // Without checksum there is no way to select right one from several headers
+    if (m_options.checksum == Checksum::Type::none)
+        m_options.max_candidates = 1;
+    m_candidates.reserve(m_options.max_candidates);
+}
+
+size_t ChannelLayer::max_frame_size_for(const Options& options, size_t stream_buffer_size)
+{
+    if (options.framing == Framing::header)
+    {
+        size_t header_size = options.extended_header ? sizeof(ChannelExtendedHeader) : sizeof(ChannelHeader);
+        return stream_buffer_size > header_size ? stream_buffer_size - header_size : 0;
+    }
+    if (options.framing == Framing::length_prefix)
+    {
+        size_t size_field = sizeof(uint16_t);
+        size_t limit = std::numeric_limits<uint16_t>::max();
+        return stream_buffer_size > size_field ? std::min(limit, stream_buffer_size - size_field) : 0;
+    }
+
+    // Worst case of COBS encoding, with checksum, parity and delimiter
+    ReedSolomon fec(options.fec_parity);
+    size_t checksum_size = options.checksum == Checksum::Type::none ? 0 : sizeof(uint32_t);
+    auto fits = [&](size_t size) {
+        return cobs_max_encoded_size(fec.encoded_size(size + checksum_size)) + 1 <= stream_buffer_size;
+    };
+    size_t low = 0, high = stream_buffer_size;
+    while (low < high)
+    {
+        size_t middle = (low + high + 1) / 2;
+        if (fits(middle))
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    return low;
+}
+
+const ChannelLayer::Options& ChannelLayer::options() const
+{
+    return m_options;
+}
+
+size_t ChannelLayer::max_payload_size() const
+{
+    if (m_options.framing != Framing::header || m_options.fec_parity == 0)
+        return m_options.max_frame_size;
+
+    // Header size field counts parity bytes too
+    size_t full_blocks = m_options.max_frame_size / ReedSolomon::block_size;
+    size_t rest = m_options.max_frame_size % ReedSolomon::block_size;
+    return full_blocks * m_fec.data_block_size() + (rest > m_options.fec_parity ? rest - m_options.fec_parity : 0);
+}
+
+size_t ChannelLayer::desync_count() const
+{
+    return m_desync_count;
+}
+
+size_t ChannelLayer::Candidate::end() const
+{
+    return body_begin + header.size;
+}
+
+bool ChannelLayer::Candidate::complete() const
+{
+    return hashed == header.size;
+}
+
+size_t ChannelLayer::header_size() const
+{
+    return m_options.extended_header ? sizeof(ChannelExtendedHeader) : sizeof(ChannelHeader);
+}
+
+bool ChannelLayer::read_header(SerialReadAccessor& accessor, size_t pos, Candidate& candidate) const
+{
+    candidate.body_begin = pos + header_size();
+    candidate.checksum_state = m_checksum.begin();
+
+    if (!m_options.extended_header)
+    {
+        candidate.header = accessor.as<ChannelHeader>(pos);
+        return true;
+    }
+
+    auto header = accessor.as<ChannelExtendedHeader>(pos);
+    if (header.header_checksum != m_header_checksum.compute(&header, offsetof(ChannelExtendedHeader, header_checksum)))
+        return false;
+
+    candidate.header.size = header.size;
+    candidate.header.checksum = header.checksum;
+    return true;
+}
+
+bool ChannelLayer::find_next_headers(SerialReadAccessor& accessor)
+{
+    if (accessor.size() < header_size())
+        return true;
+
+    const uint16_t magic = m_options.extended_header ? ChannelExtendedHeader::magic_number_value : ChannelHeader::magic_number_value;
+
+    // Header at position i is fully received if i + header_size() <= size
+    size_t search_limit = accessor.size() - header_size() + 1;
+    if (m_header_search_pos < search_limit)
+    {
+        MemSpans spans = accessor.peek_spans(0, accessor.size());
+        for (size_t i = find_magic(spans, magic, m_header_search_pos, search_limit); i < search_limit; i = find_magic(spans, magic, i + 1, search_limit))
         {
-            // Block is incorrect, bad checksum
-            it = m_decoding_instances.erase(it);
-            continue;
+            Candidate candidate;
+            if (!read_header(accessor, i, candidate) || candidate.header.size > m_options.max_frame_size)
+                continue;
+
+            if (m_candidates.size() >= m_options.max_candidates)
+            {
+                // Search will be continued from this header when some candidate is resolved
+                m_header_search_pos = i;
+                return false;
+            }
+            m_candidates.push_back(candidate);
         }
+        m_header_search_pos = search_limit;
+    }
 
-        size_t this_block_begin = it->body_begin;
-        size_t this_block_end = this_block_begin + size;
+    if (m_candidates.empty())
+    {
+        // No frame may begin before search position, so scanned bytes are not needed anymore
+        accessor.skip(m_header_search_pos);
+        m_header_search_pos = 0;
+    } else {
+        // Bytes before the first candidate are not needed too, otherwise they may fill
+        // the incoming buffer before the candidate frame is fully received
+        size_t first_header = m_candidates.front().body_begin - header_size();
+        for (const auto& candidate : m_candidates)
+            first_header = std::min(first_header, candidate.body_begin - header_size());
+        if (first_header != 0)
+            skip_frame(accessor, first_header);
+    }
+    return true;
+}
 
-        // Seccess, we have correct block
-        Buffer::ptr pbuf = Buffer::create(size);
-        accessor.skip(this_block_begin);
-        accessor.extract(pbuf->data(), size);
+void ChannelLayer::update_checksums(SerialReadAccessor& accessor)
+{
+    // If candidate is alone, most likely the stream is synchronized and candidate is a real frame,
+    // so body is extracted during checksum calculation instead of a separate pass. Body grows with
+    // received data, so false header with big size does not allocate memory for data never received
+    if (m_candidates.size() == 1 && m_options.fec_parity == 0 && !m_candidates.front().body)
+    {
+        Candidate& candidate = m_candidates.front();
+        candidate.body = Buffer::create(candidate.hashed);
+        accessor.peek(candidate.body_begin, candidate.body->data(), candidate.hashed);
+    }
 
-        // Erasing all blocks that intersect current block
+    for (auto& candidate : m_candidates)
+    {
+        size_t from = candidate.body_begin + candidate.hashed;
+        size_t available_end = std::min(candidate.end(), accessor.size());
+        if (available_end <= from)
+            continue;
 
-        // First, removing all previously found parsing instances, that are already in list.
-        // They must intersect our block, otherwise they are already checked and discarded by hash
-        for (auto jt = m_decoding_instances.begin(); jt != it; )
+        if (m_options.fec_parity != 0)
         {
-            jt = m_decoding_instances.erase(jt);
+            // Checksum of repaired body is calculated when whole body is received
+            candidate.hashed = available_end - candidate.body_begin;
+            continue;
         }
 
-        m_decoding_instances.erase(it);
-
-        for (auto jt = m_decoding_instances.begin(); jt != m_decoding_instances.end(); )
+        MemSpans body = accessor.peek_spans(from, available_end - from);
+        uint32_t state = candidate.checksum_state;
+        if (candidate.body)
         {
-            if (jt->body_begin < this_block_end)
-            {
-                // We have intersection
-                jt = m_decoding_instances.erase(jt);
-            } else {
-                jt->body_begin -= this_block_end;
-                ++jt;
-            }
+            uint8_t* dst = candidate.body->append(body.size());
+            state = m_checksum.update_copy(state, dst, body.first.begin(), body.first.size());
+            state = m_checksum.update_copy(state, dst + body.first.size(), body.second.begin(), body.second.size());
+        } else {
+            state = m_checksum.update(state, body.first.begin(), body.first.size());
+            state = m_checksum.update(state, body.second.begin(), body.second.size());
         }
+        candidate.checksum_state = state;
+        candidate.hashed += body.size();
+    }
+}
 
-        if (m_header_search_pos > this_block_end)
-            m_header_search_pos -= this_block_end;
-        else
-            m_header_search_pos = 0;
-        return pbuf;
+Buffer::ptr ChannelLayer::read_body(SerialReadAccessor& accessor, const Candidate& frame) const
+{
+    if (m_options.fec_parity == 0)
+    {
+        if (m_checksum.finish(frame.checksum_state) != frame.header.checksum)
+            return nullptr;
+
+        if (frame.body)
+            return frame.body;
 
+        Buffer::ptr pbuf = Buffer::create(frame.header.size);
+        accessor.peek(frame.body_begin, pbuf->data(), frame.header.size);
+        return pbuf;
     }
-    return nullptr;
+
+    Buffer::ptr pbuf = Buffer::create(frame.header.size);
+    accessor.peek(frame.body_begin, pbuf->data(), frame.header.size);
+    std::optional<size_t> size = m_fec.decode(pbuf->data(), pbuf->size());
+    if (!size || m_checksum.compute(pbuf->data(), *size) != frame.header.checksum)
+        return nullptr;
+
+    return Buffer::slice(pbuf, 0, *size);
 }
 
-void ChannelLayer::find_next_headers(SerialReadAccessor& accessor)
+void ChannelLayer::skip_frame(SerialReadAccessor& accessor, size_t frame_end)
 {
-    if (accessor.size() < sizeof(ChannelHeader))
-        return;
+    accessor.skip(frame_end);
+
+    // All candidates with header before frame end intersect the frame or are already skipped
+    auto it = std::remove_if(
+        m_candidates.begin(), m_candidates.end(),
+        [this, frame_end](const Candidate& c) { return c.body_begin - header_size() < frame_end; }
+    );
+    m_candidates.erase(it, m_candidates.end());
 
-    if (m_decoding_instances.empty())
+    for (auto& candidate : m_candidates)
     {
-        // we had not detected header before, so rewind buffer to headers begin
-        // TODO add code here
-        accessor.skip(m_header_search_pos);
-        size_t search_limit = accessor.size() - sizeof(ChannelHeader);
-        for (m_header_search_pos = 0; m_header_search_pos < search_limit; ++m_header_search_pos)
+        candidate.body_begin -= frame_end;
+    }
+
+    if (m_header_search_pos > frame_end)
+        m_header_search_pos -= frame_end;
+    else
+        m_header_search_pos = 0;
+}
+
+Buffer::ptr ChannelLayer::decode_single(SerialReadAccessor& accessor)
+{
+    for (;;)
+    {
+        bool all_headers_found = find_next_headers(accessor);
+        update_checksums(accessor);
+
+        for (;;)
         {
-            if (accessor.as<typeof(ChannelHeader::magic)>(m_header_search_pos) == ChannelHeader::magic_number_value)
+            // Frame that ends first is the next one in the stream
+            auto frame = m_candidates.end();
+            for (auto it = m_candidates.begin(); it != m_candidates.end(); ++it)
+            {
+                if (it->complete() && (frame == m_candidates.end() || it->end() < frame->end()))
+                    frame = it;
+            }
+
+            if (frame == m_candidates.end())
                 break;
+
+            Candidate candidate = *frame;
+            m_candidates.erase(frame);
+
+            Buffer::ptr body = read_body(accessor, candidate);
+            if (body)
+            {
+                skip_frame(accessor, candidate.end());
+                return body;
+            }
         }
-        accessor.skip(m_header_search_pos);
-        m_header_search_pos = 0;
+
+        // Continue only if header search was stopped by candidates limit and some candidates are rejected now
+        if (all_headers_found || m_candidates.size() >= m_options.max_candidates)
+            return nullptr;
     }
+}
 
-    size_t search_limit = accessor.size() - sizeof(ChannelHeader);
-    for (size_t i = m_header_search_pos; i < search_limit; ++i)
+Buffer::ptr ChannelLayer::decode_single_cobs(SerialReadAccessor& accessor)
+{
+    const size_t max_encoded_size = cobs_max_encoded_size(m_fec.encoded_size(m_options.max_frame_size + cobs_checksum_size()));
+    for (;;)
     {
-        if (accessor.as<typeof(ChannelHeader::magic)>(i) != ChannelHeader::magic_number_value)
+        size_t size = accessor.size();
+        if (m_header_search_pos >= size)
+            return nullptr;
+
+        // Every byte is checked only once, search continues from the last position
+        MemSpans spans = accessor.peek_spans(m_header_search_pos, size - m_header_search_pos);
+        size_t delimiter_pos = size;
+        auto found = reinterpret_cast<const uint8_t*>(memchr(spans.first.begin(), cobs_delimiter, spans.first.size()));
+        if (found)
+        {
+            delimiter_pos = m_header_search_pos + (found - spans.first.begin());
+        } else {
+            found = reinterpret_cast<const uint8_t*>(memchr(spans.second.begin(), cobs_delimiter, spans.second.size()));
+            if (found)
+                delimiter_pos = m_header_search_pos + spans.first.size() + (found - spans.second.begin());
+        }
+
+        if (delimiter_pos == size)
+        {
+            m_header_search_pos = size;
+            if (size > max_encoded_size || size >= accessor.capacity())
+            {
+                // Too long to be a frame or full buffer that will never get a delimiter,
+                // so we have lost delimiter and should wait for the next one
+                accessor.skip(size);
+                m_header_search_pos = 0;
+                m_cobs_discarding = true;
+                m_desync_count++;
+            }
+            return nullptr;
+        }
+
+        bool discard = m_cobs_discarding || delimiter_pos > max_encoded_size || delimiter_pos == 0;
+        m_cobs_discarding = false;
+        m_header_search_pos = 0;
+        if (discard)
+        {
+            accessor.skip(delimiter_pos + 1);
+            continue;
+        }
+
+        Buffer::ptr pbuf = Buffer::create(delimiter_pos);
+        accessor.extract(pbuf->data(), delimiter_pos);
+        accessor.skip(1);
+
+        std::optional<size_t> decoded_size = cobs_decode(pbuf->data(), delimiter_pos);
+        if (decoded_size && m_options.fec_parity != 0)
+            decoded_size = m_fec.decode(pbuf->data(), *decoded_size);
+
+        if (!decoded_size || *decoded_size < cobs_checksum_size())
             continue;
 
-        DecodingInstance new_instance;
-        new_instance.body_begin = i + sizeof(ChannelHeader);
-        new_instance.header = accessor.as<ChannelHeader>(i);
+        size_t body_size = *decoded_size - cobs_checksum_size();
+        uint32_t checksum = 0;
+        memcpy(&checksum, pbuf->data() + body_size, cobs_checksum_size());
+        if (cobs_checksum_size() != 0 && checksum != m_checksum.compute(pbuf->data(), body_size))
+            continue;
 
-        m_decoding_instances.push_back(new_instance);
+        return Buffer::slice(pbuf, 0, body_size);
     }
-    m_header_search_pos = search_limit;
 }
 
-Buffer::ptr ChannelLayer::decode_single(SerialReadAccessor& accessor)
+Buffer::ptr ChannelLayer::decode_single_length_prefix(SerialReadAccessor& accessor)
 {
-    find_next_headers(accessor);
-    return find_sucessful_instance(accessor);
+    uint16_t size = 0;
+    if (!accessor.peek(0, &size, sizeof(size)))
+        return nullptr;
+
+    if (size > m_options.max_frame_size)
+    {
+        // Sender never makes such frames, so stream position is lost and nothing may be trusted
+        accessor.skip(accessor.size());
+        m_desync_count++;
+        return nullptr;
+    }
+    if (accessor.size() < sizeof(size) + size)
+        return nullptr;
+
+    accessor.skip(sizeof(size));
+    Buffer::ptr pbuf = Buffer::create(size);
+    accessor.extract(pbuf->data(), size);
+    return pbuf;
+}
+
+size_t ChannelLayer::cobs_checksum_size() const
+{
+    return m_checksum.type() == Checksum::Type::none ? 0 : sizeof(uint32_t);
 }
 
 std::vector<Buffer::ptr> ChannelLayer::decode(SerialReadAccessor& accessor)
@@ -122,7 +505,17 @@ std::vector<Buffer::ptr> ChannelLayer::decode(SerialReadAccessor& accessor)
     Buffer::ptr next_frame_contents = nullptr;
     for (;;)
     {
-        next_frame_contents = decode_single(accessor);
+        switch (m_options.framing)
+        {
+        case Framing::cobs:
+            next_frame_contents = decode_single_cobs(accessor);
+            break;
+        case Framing::length_prefix:
+            next_frame_contents = decode_single_length_prefix(accessor);
+            break;
+        default:
+            next_frame_contents = decode_single(accessor);
+        }
         if (!next_frame_contents)
             break;
         result.push_back(next_frame_contents);
@@ -131,15 +524,105 @@ std::vector<Buffer::ptr> ChannelLayer::decode(SerialReadAccessor& accessor)
     return result;
 }
 
-void ChannelLayer::encode(SegmentBuffer& frame)
+bool ChannelLayer::encode(SegmentBuffer& frame)
 {
-    uint32_t hash = 0;
-    for (const auto& seg : frame.segments())
+    if (m_options.framing == Framing::length_prefix)
     {
-        hash = hash_Ly(seg->data(), seg->size(), hash);
+        // Receiver treats bigger size as lost synchronization
+        if (frame.size() > std::min<size_t>(m_options.max_frame_size, std::numeric_limits<uint16_t>::max()))
+            return false;
+        uint16_t size = uint16_t(frame.size());
+        memcpy(frame.prepend(sizeof(size)), &size, sizeof(size));
+        return true;
     }
+
+    uint32_t hash = m_checksum.begin();
+
+    // Data is gathered anyway for FEC or contiguous output, so checksum is calculated while copying
+    bool gather = frame.segments().size() > 1 && (m_options.contiguous_output || m_options.fec_parity != 0);
+    if (gather)
+    {
+        Buffer::ptr contiguous = Buffer::create_with_headroom(Buffer::default_headroom, frame.size());
+        uint8_t* dst = contiguous->data();
+        for (const auto& seg : frame.segments())
+        {
+            hash = m_checksum.update_copy(hash, dst, seg->data(), seg->size());
+            dst += seg->size();
+        }
+        frame = SegmentBuffer(contiguous);
+    } else {
+        for (const auto& seg : frame.segments())
+        {
+            hash = m_checksum.update(hash, seg->data(), seg->size());
+        }
+    }
+
+    if (m_options.framing == Framing::cobs)
+    {
+        encode_cobs(frame, m_checksum.finish(hash));
+        return true;
+    }
+
+    // Checksum covers original data, header size is a size of encoded one
+    if (m_options.fec_parity != 0)
+        frame = SegmentBuffer(fec_encode(frame));
+
+    if (m_options.extended_header)
+    {
+        ChannelExtendedHeader header;
+        header.checksum = m_checksum.finish(hash);
+        header.size = frame.size();
+        header.header_checksum = m_header_checksum.compute(&header, offsetof(ChannelExtendedHeader, header_checksum));
+        memcpy(frame.prepend(sizeof(header)), &header, sizeof(header));
+        return true;
+    }
+
     ChannelHeader header;
-    header.checksum = hash;
+    header.checksum = m_checksum.finish(hash);
     header.size = frame.size();
-    frame.push_front(Buffer::create(sizeof(header), &header));
+    memcpy(frame.prepend(sizeof(header)), &header, sizeof(header));
+    return true;
+}
+
+void ChannelLayer::encode_cobs(SegmentBuffer& frame, uint32_t checksum)
+{
+    if (cobs_checksum_size() != 0)
+        frame.push_back(Buffer::create(cobs_checksum_size(), &checksum));
+    if (m_options.fec_parity != 0)
+        frame = SegmentBuffer(fec_encode(frame));
+
+    // Delimiter is the only byte added besides encoding overhead
+    Buffer::ptr encoded = Buffer::create(cobs_max_encoded_size(frame.size()) + 1);
+
+    CobsEncoder encoder(encoded->data());
+    for (const auto& seg : frame.segments())
+    {
+        encoder.put(seg->data(), seg->size());
+    }
+    size_t size = encoder.finish();
+    encoded->data()[size] = cobs_delimiter;
+
+    frame = SegmentBuffer(Buffer::slice(encoded, 0, size + 1));
+}
+
+Buffer::ptr ChannelLayer::fec_encode(const SegmentBuffer& frame) const
+{
+    Buffer::ptr encoded = Buffer::create_with_headroom(Buffer::default_headroom, m_fec.encoded_size(frame.size()));
+
+    if (frame.segments().size() == 1)
+    {
+        const Buffer::ptr& seg = *frame.segments().begin();
+        m_fec.encode(seg->data(), seg->size(), encoded->data());
+        return encoded;
+    }
+
+    // Blocks may cross segments borders, so data is gathered first
+    std::vector<uint8_t> data;
+    data.reserve(frame.size());
+    for (const auto& seg : frame.segments())
+    {
+        data.insert(data.end(), seg->data(), seg->data() + seg->size());
+    }
+    m_fec.encode(data.data(), data.size(), encoded->data());
+    return encoded;
 }
@@ -0,0 +1,310 @@
+#include "ntdcp/checksum.hpp"
+#include "ntdcp/utils.hpp"
+
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #define NTDCP_X86_CRC32C
+    #include <nmmintrin.h>
+#endif
+
+using namespace ntdcp;
+
+namespace
+{
+
+constexpr uint32_t crc32c_polynomial = 0x82F63B78; // Reflected 0x1EDC6F41
+
+struct Crc32cTables
+{
+    Crc32cTables()
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++)
+                crc = (crc >> 1) ^ (crc & 1 ? crc32c_polynomial : 0);
+            table[0][i] = crc;
+        }
+
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            for (int k = 1; k < 8; k++)
+                table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+        }
+    }
+
+    uint32_t table[8][256];
+};
+
+const Crc32cTables& crc32c_tables()
+{
+    static Crc32cTables tables;
+    return tables;
+}
+
+inline uint32_t crc32c_step_8(uint32_t crc, uint32_t one, uint32_t two)
+{
+    const auto& t = crc32c_tables().table;
+    one ^= crc;
+    return t[7][one & 0xFF] ^ t[6][(one >> 8) & 0xFF] ^ t[5][(one >> 16) & 0xFF] ^ t[4][one >> 24]
+        ^ t[3][two & 0xFF] ^ t[2][(two >> 8) & 0xFF] ^ t[1][(two >> 16) & 0xFF] ^ t[0][two >> 24];
+}
+
+inline uint32_t crc32c_step_1(uint32_t crc, uint8_t byte)
+{
+    return crc32c_tables().table[0][(crc ^ byte) & 0xFF] ^ (crc >> 8);
+}
+
+uint32_t update_crc32c_slicing_by_8(uint32_t crc, const uint8_t* data, size_t size)
+{
+    while (size >= 8)
+    {
+        // Little endian is assumed as everywhere in the protocol
+        uint32_t one, two;
+        memcpy(&one, data, sizeof(one));
+        memcpy(&two, data + 4, sizeof(two));
+        crc = crc32c_step_8(crc, one, two);
+        data += 8;
+        size -= 8;
+    }
+
+    while (size--)
+        crc = crc32c_step_1(crc, *data++);
+
+    return crc;
+}
+
+uint32_t update_copy_crc32c_slicing_by_8(uint32_t crc, uint8_t* dst, const uint8_t* src, size_t size)
+{
+    while (size >= 8)
+    {
+        uint32_t one, two;
+        memcpy(&one, src, sizeof(one));
+        memcpy(&two, src + 4, sizeof(two));
+        memcpy(dst, &one, sizeof(one));
+        memcpy(dst + 4, &two, sizeof(two));
+        crc = crc32c_step_8(crc, one, two);
+        src += 8;
+        dst += 8;
+        size -= 8;
+    }
+
+    while (size--)
+    {
+        *dst = *src++;
+        crc = crc32c_step_1(crc, *dst++);
+    }
+
+    return crc;
+}
+
+#ifdef NTDCP_X86_CRC32C
+__attribute__((target("sse4.2")))
+uint32_t update_crc32c_sse42(uint32_t crc, const uint8_t* data, size_t size)
+{
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    while (size >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        size -= 8;
+    }
+    crc = uint32_t(crc64);
+#endif
+    while (size >= 4)
+    {
+        uint32_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+        data += 4;
+        size -= 4;
+    }
+
+    while (size--)
+        crc = _mm_crc32_u8(crc, *data++);
+
+    return crc;
+}
+
+__attribute__((target("sse4.2")))
+uint32_t update_copy_crc32c_sse42(uint32_t crc, uint8_t* dst, const uint8_t* src, size_t size)
+{
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    while (size >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, src, sizeof(word));
+        memcpy(dst, &word, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        src += 8;
+        dst += 8;
+        size -= 8;
+    }
+    crc = uint32_t(crc64);
+#endif
+    while (size >= 4)
+    {
+        uint32_t word;
+        memcpy(&word, src, sizeof(word));
+        memcpy(dst, &word, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+        src += 4;
+        dst += 4;
+        size -= 4;
+    }
+
+    while (size--)
+    {
+        *dst = *src++;
+        crc = _mm_crc32_u8(crc, *dst++);
+    }
+
+    return crc;
+}
+#endif
+
+inline uint16_t crc16_step(uint16_t crc, uint8_t byte)
+{
+    // Nibble table takes 32 bytes instead of 512 of byte table
+    static const uint16_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+        0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+    };
+
+    crc = uint16_t(crc << 4) ^ table[((crc >> 12) ^ (byte >> 4)) & 0x0F];
+    return uint16_t(crc << 4) ^ table[((crc >> 12) ^ (byte & 0x0F)) & 0x0F];
+}
+
+uint32_t update_crc16(uint32_t state, const uint8_t* data, size_t size)
+{
+    uint16_t crc = uint16_t(state);
+    for (size_t i = 0; i < size; i++)
+        crc = crc16_step(crc, data[i]);
+    return crc;
+}
+
+uint32_t update_copy_crc16(uint32_t state, uint8_t* dst, const uint8_t* src, size_t size)
+{
+    uint16_t crc = uint16_t(state);
+    for (size_t i = 0; i < size; i++)
+    {
+        dst[i] = src[i];
+        crc = crc16_step(crc, dst[i]);
+    }
+    return crc;
+}
+
+uint32_t update_legacy_hash(uint32_t state, const uint8_t* data, size_t size)
+{
+    return hash_Ly(data, size, state);
+}
+
+uint32_t update_none(uint32_t state, const uint8_t*, size_t)
+{
+    return state;
+}
+
+uint32_t update_copy_none(uint32_t state, uint8_t* dst, const uint8_t* src, size_t size)
+{
+    if (size != 0)
+        memcpy(dst, src, size);
+    return state;
+}
+
+uint32_t update_copy_legacy_hash(uint32_t state, uint8_t* dst, const uint8_t* src, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        dst[i] = src[i];
+        state = hash_Ly(dst[i], state);
+    }
+    return state;
+}
+
+}
+
+Checksum::Checksum(Type type, bool allow_hardware) :
+    m_type(type)
+{
+    switch (type)
+    {
+    case Type::crc32c:
+        m_update = update_crc32c_slicing_by_8;
+        m_update_copy = update_copy_crc32c_slicing_by_8;
+#ifdef NTDCP_X86_CRC32C
+        if (allow_hardware && hardware_crc32c_supported())
+        {
+            m_update = update_crc32c_sse42;
+            m_update_copy = update_copy_crc32c_sse42;
+        }
+#endif
+        m_initial = 0xFFFFFFFF;
+        m_final_xor = 0xFFFFFFFF;
+        break;
+
+    case Type::crc16:
+        m_update = update_crc16;
+        m_update_copy = update_copy_crc16;
+        m_initial = 0xFFFF;
+        m_final_xor = 0;
+        break;
+
+    case Type::none:
+        m_update = update_none;
+        m_update_copy = update_copy_none;
+        m_initial = 0;
+        m_final_xor = 0;
+        break;
+
+    default:
+        m_update = update_legacy_hash;
+        m_update_copy = update_copy_legacy_hash;
+        m_initial = 0;
+        m_final_xor = 0;
+    }
+}
+
+Checksum::Type Checksum::type() const
+{
+    return m_type;
+}
+
+uint32_t Checksum::begin() const
+{
+    return m_initial;
+}
+
+uint32_t Checksum::update(uint32_t state, const void* data, size_t size) const
+{
+    return m_update(state, reinterpret_cast<const uint8_t*>(data), size);
+}
+
+uint32_t Checksum::update_copy(uint32_t state, void* dst, const void* src, size_t size) const
+{
+    return m_update_copy(state, reinterpret_cast<uint8_t*>(dst), reinterpret_cast<const uint8_t*>(src), size);
+}
+
+uint32_t Checksum::finish(uint32_t state) const
+{
+    return state ^ m_final_xor;
+}
+
+uint32_t Checksum::compute(const void* data, size_t size) const
+{
+    return finish(update(begin(), data, size));
+}
+
+bool Checksum::hardware_crc32c_supported()
+{
+#ifdef NTDCP_X86_CRC32C
+    static const bool supported = __builtin_cpu_supports("sse4.2");
+    return supported;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,85 @@
+#include "ntdcp/codel.hpp"
+
+#include <cmath>
+
+using namespace ntdcp;
+
+CoDel::CoDel() :
+    CoDel(Options())
+{
+}
+
+CoDel::CoDel(const Options& options) :
+    m_options(options)
+{
+}
+
+const CoDel::Options& CoDel::options() const
+{
+    return m_options;
+}
+
+bool CoDel::should_drop(std::chrono::steady_clock::duration sojourn, std::chrono::steady_clock::time_point now, bool queue_empty)
+{
+    if (m_options.target.count() == 0)
+        return false;
+
+    bool ok = ok_to_drop(sojourn, now, queue_empty);
+    if (m_dropping)
+    {
+        if (!ok)
+        {
+            m_dropping = false;
+            return false;
+        }
+        if (now < m_drop_next)
+            return false;
+
+        m_count++;
+        m_drop_next = control_law(m_drop_next);
+        return true;
+    }
+
+    if (!ok)
+        return false;
+
+    // Drop rate is restored if queue was standing recently
+    m_dropping = true;
+    uint32_t delta = m_count - m_last_count;
+    if (delta > 1 && now - m_drop_next < 16 * m_options.interval)
+        m_count = delta;
+    else
+        m_count = 1;
+    m_last_count = m_count;
+    m_drop_next = control_law(now);
+    return true;
+}
+
+bool CoDel::dropping() const
+{
+    return m_dropping;
+}
+
+bool CoDel::ok_to_drop(std::chrono::steady_clock::duration sojourn, std::chrono::steady_clock::time_point now, bool queue_empty)
+{
+    if (sojourn < m_options.target || queue_empty)
+    {
+        m_above_target = false;
+        return false;
+    }
+
+    if (!m_above_target)
+    {
+        m_above_target = true;
+        m_first_above_time = now + m_options.interval;
+        return false;
+    }
+    return now >= m_first_above_time;
+}
+
+std::chrono::steady_clock::time_point CoDel::control_law(std::chrono::steady_clock::time_point t) const
+{
+    auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(m_options.interval);
+    return t + std::chrono::steady_clock::duration(
+        std::chrono::steady_clock::duration::rep(interval.count() / std::sqrt(double(m_count))));
+}
@@ -0,0 +1,73 @@
+#include "ntdcp/duplicate-filter.hpp"
+
+#include <algorithm>
+
+using namespace ntdcp;
+
+DuplicateFilter::DuplicateFilter() :
+    DuplicateFilter(Options())
+{
+}
+
+DuplicateFilter::DuplicateFilter(const Options& options) :
+    m_options(options),
+    m_table(std::min(options.initial_capacity, options.max_capacity))
+{
+}
+
+bool DuplicateFilter::check_update(uint64_t source_addr, uint16_t package_id, std::chrono::steady_clock::time_point now)
+{
+    if (now - m_window_begin >= m_options.window)
+    {
+        // Table is rebuilt only if the whole window fits a quarter of it, so shrink is not followed by grow
+        size_t min_capacity = std::min(m_options.initial_capacity, m_options.max_capacity);
+        if (m_table.capacity() > min_capacity && m_window_inserts * 4 < m_table.capacity())
+            resize(std::max(m_table.capacity() / 2, min_capacity), now);
+        m_window_begin = now;
+        m_window_inserts = 0;
+    }
+
+    Key key{source_addr, package_id};
+    if (auto seen = m_table.find_update(key))
+    {
+        if (now - *seen < m_options.window)
+            return true;
+
+        // The same id was reused after the window, it is a new package
+        *seen = now;
+        m_window_inserts++;
+        return false;
+    }
+
+    if (m_table.size() == m_table.capacity() && m_table.capacity() < m_options.max_capacity)
+    {
+        // Forgetting a package that is still inside the window may let it loop
+        if (now - *m_table.oldest() < m_options.window)
+            resize(std::min(m_table.capacity() * 2, m_options.max_capacity), now);
+    }
+
+    *m_table.insert_update(key).first = now;
+    m_window_inserts++;
+    return false;
+}
+
+size_t DuplicateFilter::size() const
+{
+    return m_table.size();
+}
+
+size_t DuplicateFilter::capacity() const
+{
+    return m_table.capacity();
+}
+
+void DuplicateFilter::resize(size_t capacity, std::chrono::steady_clock::time_point now)
+{
+    Table table(capacity);
+    // Entries go from the oldest one, so the newest are kept if they do not fit
+    m_table.for_each([&](const Key& key, const std::chrono::steady_clock::time_point& seen) {
+        if (now - seen < m_options.window)
+            *table.insert_update(key).first = seen;
+    });
+    m_table = std::move(table);
+}
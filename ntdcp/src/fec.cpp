@@ -0,0 +1,325 @@
+#include "ntdcp/fec.hpp"
+
+#include <algorithm>
+#include <initializer_list>
+#include <cstring>
+
+using namespace ntdcp;
+
+namespace
+{
+
+struct GaloisTables
+{
+    GaloisTables()
+    {
+        // Primitive polynomial x^8 + x^4 + x^3 + x^2 + 1
+        uint16_t x = 1;
+        for (int i = 0; i < 255; i++)
+        {
+            exp[i] = uint8_t(x);
+            log[x] = uint8_t(i);
+            x <<= 1;
+            if (x & 0x100)
+                x ^= 0x11D;
+        }
+        // Doubled table to avoid modulo in multiplication
+        for (int i = 255; i < 512; i++)
+            exp[i] = exp[i - 255];
+    }
+
+    uint8_t exp[512];
+    uint8_t log[256] = {};
+};
+
+const GaloisTables& gf()
+{
+    static GaloisTables tables;
+    return tables;
+}
+
+uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+    if (a == 0 || b == 0)
+        return 0;
+    return gf().exp[gf().log[a] + gf().log[b]];
+}
+
+uint8_t gf_div(uint8_t a, uint8_t b)
+{
+    if (a == 0)
+        return 0;
+    return gf().exp[gf().log[a] + 255 - gf().log[b]];
+}
+
+uint8_t gf_pow2(int power)
+{
+    return gf().exp[((power % 255) + 255) % 255];
+}
+
+uint8_t gf_inverse(uint8_t a)
+{
+    return gf().exp[255 - gf().log[a]];
+}
+
+/**
+ * Polynomial with highest power coefficient first
+ */
+struct Poly
+{
+    constexpr static size_t capacity = 2 * ReedSolomon::block_size + 2;
+
+    uint8_t c[capacity];
+    size_t size = 0;
+
+    Poly() = default;
+
+    Poly(std::initializer_list<uint8_t> coefs)
+    {
+        for (uint8_t coef : coefs)
+            c[size++] = coef;
+    }
+
+    uint8_t eval(uint8_t x) const
+    {
+        uint8_t y = c[0];
+        for (size_t i = 1; i < size; i++)
+            y = gf_mul(y, x) ^ c[i];
+        return y;
+    }
+
+    Poly scale(uint8_t x) const
+    {
+        Poly result;
+        result.size = size;
+        for (size_t i = 0; i < size; i++)
+            result.c[i] = gf_mul(c[i], x);
+        return result;
+    }
+
+    Poly add(const Poly& other) const
+    {
+        Poly result;
+        result.size = std::max(size, other.size);
+        memset(result.c, 0, result.size);
+        for (size_t i = 0; i < size; i++)
+            result.c[i + result.size - size] = c[i];
+        for (size_t i = 0; i < other.size; i++)
+            result.c[i + result.size - other.size] ^= other.c[i];
+        return result;
+    }
+
+    Poly mul(const Poly& other) const
+    {
+        Poly result;
+        result.size = size + other.size - 1;
+        memset(result.c, 0, result.size);
+        for (size_t j = 0; j < other.size; j++)
+        {
+            for (size_t i = 0; i < size; i++)
+                result.c[i + j] ^= gf_mul(c[i], other.c[j]);
+        }
+        return result;
+    }
+
+    Poly reversed() const
+    {
+        Poly result;
+        result.size = size;
+        std::reverse_copy(c, c + size, result.c);
+        return result;
+    }
+};
+
+}
+
+ReedSolomon::ReedSolomon(size_t parity_size) :
+    m_parity_size(std::min(parity_size, block_size - 1))
+{
+    // g(x) = (x - a^0)(x - a^1)...(x - a^(parity - 1))
+    Poly generator{1};
+    for (size_t i = 0; i < m_parity_size; i++)
+        generator = generator.mul(Poly{1, gf_pow2(int(i))});
+
+    memcpy(m_generator, generator.c, generator.size);
+}
+
+size_t ReedSolomon::parity_size() const
+{
+    return m_parity_size;
+}
+
+size_t ReedSolomon::data_block_size() const
+{
+    return block_size - m_parity_size;
+}
+
+size_t ReedSolomon::encoded_size(size_t data_size) const
+{
+    size_t blocks = (data_size + data_block_size() - 1) / data_block_size();
+    return data_size + blocks * m_parity_size;
+}
+
+void ReedSolomon::encode(const uint8_t* data, size_t size, uint8_t* output) const
+{
+    while (size != 0)
+    {
+        size_t part = std::min(size, data_block_size());
+        memcpy(output, data, part);
+        encode_block(data, part, output + part);
+        data += part;
+        size -= part;
+        output += part + m_parity_size;
+    }
+}
+
+std::optional<size_t> ReedSolomon::decode(uint8_t* data, size_t size) const
+{
+    size_t read = 0, write = 0;
+    while (read < size)
+    {
+        size_t part = std::min(size - read, block_size);
+        if (part <= m_parity_size)
+            return std::nullopt;
+
+        if (!correct_block(data + read, part))
+            return std::nullopt;
+
+        size_t data_part = part - m_parity_size;
+        memmove(data + write, data + read, data_part);
+        read += part;
+        write += data_part;
+    }
+    return write;
+}
+
+void ReedSolomon::encode_block(const uint8_t* data, size_t size, uint8_t* parity) const
+{
+    // Remainder of data * x^parity divided by generator, computed with LFSR
+    memset(parity, 0, m_parity_size);
+    for (size_t i = 0; i < size; i++)
+    {
+        uint8_t coef = data[i] ^ parity[0];
+        memmove(parity, parity + 1, m_parity_size - 1);
+        parity[m_parity_size - 1] = 0;
+        if (coef == 0)
+            continue;
+        for (size_t j = 0; j < m_parity_size; j++)
+            parity[j] ^= gf_mul(m_generator[j + 1], coef);
+    }
+}
+
+bool ReedSolomon::correct_block(uint8_t* block, size_t size) const
+{
+    if (m_parity_size == 0)
+        return true;
+
+    Poly message;
+    message.size = size;
+    memcpy(message.c, block, size);
+
+    // Syndromes with leading zero that simplifies indexing below
+    Poly syndromes;
+    syndromes.size = m_parity_size + 1;
+    syndromes.c[0] = 0;
+    bool has_errors = false;
+    for (size_t i = 0; i < m_parity_size; i++)
+    {
+        syndromes.c[i + 1] = message.eval(gf_pow2(int(i)));
+        has_errors = has_errors || syndromes.c[i + 1] != 0;
+    }
+    if (!has_errors)
+        return true;
+
+    // Berlekamp-Massey algorithm for error locator polynomial
+    Poly error_locator{1};
+    Poly old_locator{1};
+    for (size_t i = 0; i < m_parity_size; i++)
+    {
+        size_t k = i + 1;
+        uint8_t delta = syndromes.c[k];
+        for (size_t j = 1; j < error_locator.size; j++)
+            delta ^= gf_mul(error_locator.c[error_locator.size - 1 - j], syndromes.c[k - j]);
+
+        old_locator.c[old_locator.size++] = 0;
+        if (delta == 0)
+            continue;
+
+        if (old_locator.size > error_locator.size)
+        {
+            Poly new_locator = old_locator.scale(delta);
+            old_locator = error_locator.scale(gf_inverse(delta));
+            error_locator = new_locator;
+        }
+        error_locator = error_locator.add(old_locator.scale(delta));
+    }
+
+    size_t leading_zeros = 0;
+    while (leading_zeros < error_locator.size && error_locator.c[leading_zeros] == 0)
+        leading_zeros++;
+    memmove(error_locator.c, error_locator.c + leading_zeros, error_locator.size - leading_zeros);
+    error_locator.size -= leading_zeros;
+    if (error_locator.size == 0)
+        return false;
+
+    size_t errors_count = error_locator.size - 1;
+    if (errors_count * 2 > m_parity_size)
+        return false;
+
+    // Chien search for error positions
+    Poly reversed_locator = error_locator.reversed();
+    size_t error_positions[block_size];
+    size_t found = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (reversed_locator.eval(gf_pow2(int(i))) == 0)
+        {
+            if (found == errors_count)
+                return false;
+            error_positions[found++] = size - 1 - i;
+        }
+    }
+    if (found != errors_count)
+        return false;
+
+    // Forney algorithm for error magnitudes
+    Poly errata_locator{1};
+    uint8_t x[block_size];
+    for (size_t i = 0; i < found; i++)
+    {
+        int coef_pos = int(size - 1 - error_positions[i]);
+        x[i] = gf_pow2(coef_pos);
+        errata_locator = errata_locator.mul(Poly{x[i], 1});
+    }
+
+    // Error evaluator is a remainder of syndromes * locator divided by x^(errors + 1)
+    Poly product = syndromes.reversed().mul(errata_locator);
+    Poly evaluator;
+    evaluator.size = std::min(product.size, errata_locator.size);
+    memcpy(evaluator.c, product.c + product.size - evaluator.size, evaluator.size);
+
+    for (size_t i = 0; i < found; i++)
+    {
+        uint8_t x_inverse = gf_inverse(x[i]);
+        uint8_t locator_derivative = 1;
+        for (size_t j = 0; j < found; j++)
+        {
+            if (j != i)
+                locator_derivative = gf_mul(locator_derivative, 1 ^ gf_mul(x_inverse, x[j]));
+        }
+        if (locator_derivative == 0)
+            return false;
+
+        uint8_t y = gf_mul(x[i], evaluator.eval(x_inverse));
+        block[error_positions[i]] ^= gf_div(y, locator_derivative);
+    }
+
+    // Too many errors may lead to wrong correction that is still detectable
+    memcpy(message.c, block, size);
+    for (size_t i = 0; i < m_parity_size; i++)
+    {
+        if (message.eval(gf_pow2(int(i))) != 0)
+            return false;
+    }
+    return true;
+}
@@ -1,26 +1,43 @@
 #include "ntdcp/network.hpp"
 
+#include <limits>
+#include <cstring>
+
 using namespace ntdcp;
 
 
 
+NetworkLayer::Interface::Interface(IPhysicalInterface::ptr phys, const TxScheduler::Options& tx_queue) :
+    phys(phys), channel(phys->options().channel_options()), outgoing(tx_queue)
+{
+}
+
 NetworkLayer::NetworkLayer(SystemDriver::ptr sys, uint64_t addr) :
-    m_sys(sys), m_addr(addr)
+    NetworkLayer(sys, addr, Options())
 {
+}
 
+NetworkLayer::NetworkLayer(SystemDriver::ptr sys, uint64_t addr, const Options& options) :
+    m_sys(sys), m_addr(addr), m_options(options),
+    m_packages_already_received(options.duplicate_filter),
+    m_routing(options.routing),
+    m_relay_election(addr, options.relay_election)
+{
+    if (m_options.rx_worker_threads != 0)
+        m_rx_workers = std::make_unique<WorkerPool>(m_options.rx_worker_threads);
 }
 
 void NetworkLayer::add_physical(IPhysicalInterface::ptr phys)
 {
-    m_phys_devices.push_back(phys);
+    m_interfaces.push_back(std::make_unique<Interface>(phys, m_options.tx_queue));
 }
 
-void NetworkLayer::send(Buffer::ptr data, uint64_t destination_addr, uint8_t hop_limit)
+NetworkLayer::SendStatus NetworkLayer::send(Buffer::ptr data, uint64_t destination_addr, uint8_t hop_limit, TrafficClass traffic_class)
 {
-    send(SegmentBuffer(data), destination_addr, hop_limit);
+    return send(SegmentBuffer(data), destination_addr, hop_limit, traffic_class);
 }
 
-void NetworkLayer::send(SegmentBuffer data, uint64_t destination_addr, uint8_t hop_limit)
+NetworkLayer::SendStatus NetworkLayer::send(SegmentBuffer data, uint64_t destination_addr, uint8_t hop_limit, TrafficClass traffic_class)
 {
     uint16_t package_id = random_id();
     if (address_acceptable(destination_addr))
@@ -32,7 +49,7 @@ void NetworkLayer::send(SegmentBuffer data, uint64_t destination_addr, uint8_t h
         m_incoming.push(p);
 
         if (destination_addr == m_addr) // Package is directly for me
-            return;
+            return SendStatus::queued;
     }
 
     // Do not forget send to myself (if addr is good) and put id to m_packages_already_received
@@ -40,25 +57,18 @@ void NetworkLayer::send(SegmentBuffer data, uint64_t destination_addr, uint8_t h
     package.source_addr = m_addr;
     package.destination_addr = destination_addr;
     package.package_id = package_id;
-    package.hop_limit = hop_limit;
-
-    m_packages_already_received.check_update(package.package_id);
+    package.hop_limit = m_routing.hop_limit(destination_addr, hop_limit, m_sys->now());
 
-    /// @todo Optimize using segment buffer to prevent copying
+    m_packages_already_received.check_update(package.source_addr, package.package_id, m_sys->now());
 
     encode(package, data);
-    m_channel.encode(data);
-    Buffer::ptr to_send_encoded = data.merge();
-
-    for (const auto& dev : m_phys_devices)
-    {
-        m_outgoing[dev].push(to_send_encoded);
-    }
+    return route(data, destination_addr, nullptr, traffic_class);
 }
 
 void NetworkLayer::serve()
 {
     serve_incoming();
+    serve_routing();
     serve_outgoing();
 }
 
@@ -67,80 +77,327 @@ SystemDriver::ptr NetworkLayer::system_driver()
     return m_sys;
 }
 
-void NetworkLayer::serve_incoming()
+void NetworkLayer::decode_incoming(Interface& interface)
 {
-    for (auto& phys : m_phys_devices)
+    interface.received.clear();
+    SerialReadAccessor& inc = interface.phys->incoming();
+    if (inc.empty())
+        return;
+
+    const bool aggregation = interface.phys->options().aggregation;
+    for (const auto& frame : interface.channel.decode(inc))
     {
-        SerialReadAccessor& inc = phys->incoming();
-        if (inc.empty())
+        if (!aggregation)
+        {
+            decode_package(interface, frame);
             continue;
+        }
 
-        std::vector<Buffer::ptr> frames = m_channel.decode(inc);
-        if (frames.empty())
+        // Splitting aggregated frame to packages without copying
+        const uint8_t* data = frame->data();
+        if (frame->size() < 1)
+            continue;
+        size_t count = data[0];
+        size_t offset = 1 + count * sizeof(uint16_t);
+        if (offset > frame->size())
             continue;
 
-        for (const auto& frame : frames)
+        for (size_t i = 0; i < count; i++)
+        {
+            uint16_t size;
+            memcpy(&size, data + 1 + i * sizeof(uint16_t), sizeof(size));
+            if (offset + size > frame->size())
+                break;
+            decode_package(interface, Buffer::slice(frame, offset, size));
+            offset += size;
+        }
+    }
+}
+
+void NetworkLayer::decode_package(Interface& interface, const Buffer::ptr& data)
+{
+    auto pkg = decode(data);
+    if (pkg)
+        interface.received.push_back(std::move(*pkg));
+}
+
+void NetworkLayer::serve_incoming()
+{
+    // Decoding of every interface touches only its own state, so it may be done concurrently
+    if (m_rx_workers)
+    {
+        m_rx_workers->run(m_interfaces.size(), [this](size_t i) { decode_incoming(*m_interfaces[i]); });
+    } else {
+        for (auto& interface : m_interfaces)
+            decode_incoming(*interface);
+    }
+
+    // Packages are processed in the same order regardless of decoding mode
+    for (size_t i = 0; i < m_interfaces.size(); i++)
+    {
+        Interface& interface = *m_interfaces[i];
+        for (const auto& pkg : interface.received)
         {
-            auto pkg = decode(frame->contents());
-            if (!pkg)
+            const PackageHeader& header = pkg.first;
+
+            // Every copy is used for learning, copy that passed fewer relays gives better route
+            if (header.source_addr != m_addr)
+                m_routing.learn(header.source_addr, header.package_id, i, header.hop_limit, m_sys->now());
+
+            if (m_packages_already_received.check_update(header.source_addr, header.package_id, m_sys->now()))
                 continue;
 
-            const PackageHeader& header = pkg->first;
+            if (header.destination_addr == RelayElection::hello_addr)
+            {
+                m_relay_election.process_hello(header.source_addr, pkg.second, m_sys->now());
+                continue;
+            }
 
-            if (m_packages_already_received.check_update(header.package_id))
+            if (header.destination_addr == RoutingTable::advertisement_addr)
+            {
+                m_routing.process_advertisement(pkg.second, m_addr, header.source_addr, i,
+                                                interface.phys->options().link_cost, m_sys->now());
                 continue;
+            }
 
             if (address_acceptable(header.destination_addr))
             {
                 Package p;
                 p.source_addr = header.source_addr;
-                p.data = pkg->second;
+                p.data = pkg.second;
                 p.package_id = header.package_id;
                 m_incoming.push(p);
                 continue;
             }
 
-            retransmit(header, pkg->second, phys);
+            retransmit(header, pkg.second, interface);
+        }
+        interface.received.clear();
+    }
+}
+
+void NetworkLayer::serve_routing()
+{
+    auto now = m_sys->now();
+
+    const auto& hello_period = m_relay_election.options().hello_period;
+    if (hello_period.count() != 0 && (!m_last_hello || now - *m_last_hello >= hello_period))
+    {
+        m_last_hello = now;
+        SegmentBuffer package = make_link_local(m_relay_election.make_hello(now), RelayElection::hello_addr);
+        for (auto& interface : m_interfaces)
+            enqueue(*interface, package, TrafficClass::control, true);
+    }
+
+    const RoutingTable::Options& opts = m_routing.options();
+    if (!opts.enabled || opts.advertisement_period.count() == 0)
+        return;
+
+    if (m_last_advertisement && now - *m_last_advertisement < opts.advertisement_period)
+        return;
+    m_last_advertisement = now;
+
+    // Every advertisement should be a single frame on every interface
+    size_t max_size = std::numeric_limits<size_t>::max();
+    for (const auto& interface : m_interfaces)
+    {
+        const PhysicalInterfaceOptions& phys_opts = interface->phys->options();
+        // Channel frame size is already limited by ring_buffer_size
+        size_t frame_size = interface->channel.max_payload_size();
+        if (phys_opts.aggregation)
+        {
+            // Aggregated frame has count and size fields even for a single package
+            const size_t index_size = 1 + sizeof(uint16_t);
+            frame_size = std::min(frame_size, phys_opts.aggregation_max_size);
+            frame_size = frame_size > index_size ? frame_size - index_size : 0;
         }
+        max_size = std::min(max_size, frame_size);
+    }
+    size_t header_size = make_link_local(Buffer::create(0), RoutingTable::advertisement_addr).size();
+    max_size = max_size > header_size ? max_size - header_size : 0;
+
+    for (const auto& advertisement : m_routing.make_advertisements(m_addr, now, max_size))
+    {
+        // Every interface gets its own package id, so a neighbour on several links processes all of them
+        for (auto& interface : m_interfaces)
+            enqueue(*interface, make_link_local(advertisement, RoutingTable::advertisement_addr), TrafficClass::control, true);
     }
 }
 
+SegmentBuffer NetworkLayer::make_link_local(Buffer::ptr data, uint64_t destination_addr)
+{
+    // Link-local packages are never retransmitted
+    PackageHeader header;
+    header.source_addr = m_addr;
+    header.destination_addr = destination_addr;
+    header.package_id = random_id();
+    header.hop_limit = 0;
+
+    SegmentBuffer package(data);
+    encode(header, package);
+    return package;
+}
+
 void NetworkLayer::serve_outgoing()
 {
     // Sending data to physical devices
-    for (auto it = m_outgoing.begin(); it != m_outgoing.end(); ++it)
+    for (auto& interface : m_interfaces)
     {
-        IPhysicalInterface::ptr dev = it->first;
-        std::queue<Buffer::ptr>& queue = it->second;
+        while (!interface->outgoing.empty() && !interface->phys->busy())
+        {
+            if (interface->phys->options().aggregation && !aggregation_ready(*interface))
+                break;
+            send_next_frame(*interface);
+        }
+    }
+}
+
+bool NetworkLayer::enqueue(Interface& interface, const SegmentBuffer& package, TrafficClass traffic_class, bool replaceable)
+{
+    return interface.outgoing.push(traffic_class, package, m_sys->now(), replaceable);
+}
+
+bool NetworkLayer::congested(TrafficClass traffic_class) const
+{
+    for (const auto& interface : m_interfaces)
+    {
+        if (congested(*interface, traffic_class))
+            return true;
+    }
+    return false;
+}
+
+bool NetworkLayer::congested(const Interface& interface, TrafficClass traffic_class) const
+{
+    if (interface.outgoing.full())
+        return true;
+
+    const CoDel::Options& codel = interface.outgoing.options().codel;
+    auto oldest = interface.outgoing.oldest(traffic_class);
+    if (codel.target.count() == 0 || !oldest)
+        return false;
+
+    // Aggregated packages wait for others intentionally
+    auto acceptable = std::chrono::steady_clock::duration(codel.target);
+    if (interface.phys->options().aggregation)
+        acceptable += interface.phys->options().aggregation_hold_time;
+    return m_sys->now() - *oldest >= acceptable;
+}
+
+bool NetworkLayer::aggregation_ready(const Interface& interface) const
+{
+    const PhysicalInterfaceOptions& opts = interface.phys->options();
+    if (interface.outgoing.bytes() + interface.outgoing.size() * sizeof(uint16_t) + 1 >= opts.aggregation_max_size)
+        return true;
+    if (interface.outgoing.size() >= std::numeric_limits<uint8_t>::max())
+        return true;
+    return m_sys->now() - *interface.outgoing.oldest() >= opts.aggregation_hold_time;
+}
+
+void NetworkLayer::send_next_frame(Interface& interface)
+{
+    auto now = m_sys->now();
+
+    // Segments are sent as is, without concatenation
+    SegmentBuffer frame;
+    if (!interface.phys->options().aggregation)
+    {
+        if (!interface.outgoing.peek(now))
+            return;
+        frame = interface.outgoing.pop();
+    } else {
+        const size_t max_size = interface.phys->options().aggregation_max_size;
+        uint8_t index[1 + std::numeric_limits<uint8_t>::max() * sizeof(uint16_t)];
+        uint8_t count = 0;
+        size_t size = 1;
+        while (count != std::numeric_limits<uint8_t>::max())
+        {
+            const SegmentBuffer* package = interface.outgoing.peek(now);
+            if (!package)
+                break;
+            size_t package_size = package->size();
+            // The first package is sent even if it is too big
+            if (count != 0 && size + sizeof(uint16_t) + package_size > max_size)
+                break;
+
+            uint16_t size_field = uint16_t(package_size);
+            memcpy(index + 1 + count * sizeof(uint16_t), &size_field, sizeof(size_field));
+            frame.push_back(interface.outgoing.pop());
+            count++;
+            size += sizeof(uint16_t) + package_size;
+        }
+        if (count == 0)
+            return;
+        index[0] = count;
+        frame.push_front(Buffer::create_with_headroom(Buffer::default_headroom, 1 + count * sizeof(uint16_t), index));
+    }
 
-        while (!queue.empty() && !dev->busy())
+    if (interface.channel.encode(frame))
+        interface.phys->send(frame);
+}
+
+NetworkLayer::SendStatus NetworkLayer::route(const SegmentBuffer& package, uint64_t destination_addr, const Interface* came_from, TrafficClass traffic_class)
+{
+    size_t queued = 0, dropped = 0;
+    bool congestion = false;
+    auto put = [&](Interface& interface) {
+        if (!enqueue(interface, package, traffic_class))
         {
-            dev->send(queue.front());
-            queue.pop();
+            dropped++;
+            return;
         }
+        queued++;
+        congestion = congestion || congested(interface, traffic_class);
+    };
+
+    auto status = [&]() {
+        if (dropped != 0 && queued == 0)
+            return SendStatus::dropped;
+        if (dropped != 0 || congestion)
+            return SendStatus::congested;
+        return SendStatus::queued;
+    };
+
+    if (destination_addr != 0xFF)
+    {
+        auto known = m_routing.find(destination_addr, m_sys->now());
+        if (known)
+        {
+            Interface& interface = *m_interfaces[known->interface];
+            // Destination is behind the interface package came from, so it was already sent there.
+            // Other neighbours on that medium heard it too, so like floods it is repeated only by relays
+            bool back = &interface == came_from;
+            if (!back || (interface.phys->options().retransmit_back && m_relay_election.is_relay(m_sys->now())))
+                put(interface);
+            return status();
+        }
+    }
+
+    // Floods are retransmitted only by elected relays
+    if (came_from && !m_relay_election.is_relay(m_sys->now()))
+        return status();
+
+    for (auto& interface : m_interfaces)
+    {
+        if (interface.get() == came_from && !came_from->phys->options().retransmit_back)
+            continue;
+
+        put(*interface);
     }
+    return status();
 }
 
-void NetworkLayer::retransmit(const PackageHeader& pkg, Buffer::ptr data, IPhysicalInterface::ptr came_from)
+void NetworkLayer::retransmit(const PackageHeader& pkg, Buffer::ptr data, const Interface& came_from)
 {
     if (pkg.hop_limit == 0)
         return;
 
     PackageHeader to_send = pkg;
-    to_send.hop_limit -= 1;
+    to_send.hop_limit = m_routing.hop_limit(pkg.destination_addr, pkg.hop_limit - 1, m_sys->now());
 
     SegmentBuffer seg_buf(data);
     encode(to_send, seg_buf);
-    m_channel.encode(seg_buf);
-    Buffer::ptr to_send_encoded = seg_buf.merge();
-
-    for (auto& dev : m_phys_devices)
-    {
-        if (dev == came_from && !came_from->options().retransmit_back)
-            continue;
-
-        m_outgoing[dev].push(to_send_encoded);
-    }
+    route(seg_buf, pkg.destination_addr, &came_from, TrafficClass::forwarded);
 }
 
 bool NetworkLayer::address_acceptable(uint64_t addr)
@@ -173,9 +430,9 @@ uint16_t NetworkLayer::random_id()
     }
 }
 
-std::optional<std::pair<NetworkLayer::PackageHeader, Buffer::ptr>> NetworkLayer::decode(const MemBlock& mem_block)
+std::optional<std::pair<NetworkLayer::PackageHeader, Buffer::ptr>> NetworkLayer::decode(const Buffer::ptr& frame)
 {
-    // TODO add here size checks
+    const MemBlock mem_block = frame->contents();
     MemBlock m(mem_block);
     if (mem_block.size() < sizeof(uint8_t))
         return std::nullopt;
@@ -209,7 +466,8 @@ std::optional<std::pair<NetworkLayer::PackageHeader, Buffer::ptr>> NetworkLayer:
         return std::nullopt;
     package.destination_addr = *dst_addr;
 
-    return std::make_pair(package, Buffer::create(m.size(), m.begin()));
+    // Payload is not copied, it is a part of the frame
+    return std::make_pair(package, Buffer::slice(frame, m.begin() - mem_block.begin()));
 }
 
 void NetworkLayer::encode(PackageHeader package, SegmentBuffer& buf)
@@ -230,17 +488,19 @@ void NetworkLayer::encode(PackageHeader package, SegmentBuffer& buf)
     flag_byte |= dst_addr_size_bits << 2;
     flag_byte |= hop_limit_bits << 4;
 
-    Buffer::ptr header = Buffer::create();
-    auto raw = header->raw();
-    raw << flag_byte;
-    raw << package.package_id;
+    size_t header_size = sizeof(flag_byte) + sizeof(package.package_id)
+        + (src_addr_size_bits + 1) + (dst_addr_size_bits + 1);
     if (hop_limit_bits == 0xF)
-        header->raw() << package.hop_limit;
-    put_address_to_buffer(header, package.source_addr);
-    put_address_to_buffer(header, package.destination_addr);
-
+        header_size += sizeof(package.hop_limit);
 
-    buf.push_front(header);
+    uint8_t* p = buf.prepend(header_size);
+    *p++ = flag_byte;
+    memcpy(p, &package.package_id, sizeof(package.package_id));
+    p += sizeof(package.package_id);
+    if (hop_limit_bits == 0xF)
+        *p++ = package.hop_limit;
+    p = write_address(p, package.source_addr, src_addr_size_bits);
+    write_address(p, package.destination_addr, dst_addr_size_bits);
 }
 
 uint8_t NetworkLayer::get_addr_size_bits(uint64_t addr)
@@ -259,36 +519,14 @@ uint8_t NetworkLayer::get_addr_size_bits(uint64_t addr)
     }
 }
 
-void NetworkLayer::put_address_to_buffer(Buffer::ptr buf, uint64_t addr)
+uint8_t* NetworkLayer::write_address(uint8_t* dst, uint64_t addr, uint8_t address_size_bits)
 {
-    if (addr <= 0xFF)
-    {
-        uint8_t x = uint8_t(addr);
-        buf->raw() << x;
-    } else if (addr <= 0xFFFF)
+    // Big endian, the same as read_addr_from_mem expects
+    for (int i = address_size_bits; i >= 0; i--)
     {
-        uint8_t x1 = addr & 0xFF;
-        addr >>= 8;
-        uint8_t x2 = addr & 0xFF;
-        buf->raw() << x2 << x1;
-    } else if (addr <= 0xFFFFFF)
-    {
-        uint8_t x1 = addr & 0xFF;
-        addr >>= 8;
-        uint8_t x2 = addr & 0xFF;
-        addr >>= 8;
-        uint8_t x3 = addr & 0xFF;
-        buf->raw() << x3 << x2 << x1;
-    } else {
-        uint8_t x1 = addr & 0xFF;
-        addr >>= 8;
-        uint8_t x2 = addr & 0xFF;
-        addr >>= 8;
-        uint8_t x3 = addr & 0xFF;
-        addr >>= 8;
-        uint8_t x4 = addr & 0xFF;
-        buf->raw() << x4 << x3 << x2 << x1;
+        *dst++ = uint8_t(addr >> (8 * i));
     }
+    return dst;
 }
 
 std::optional<uint64_t> NetworkLayer::read_addr_from_mem(MemBlock& data, uint8_t address_size_bits)
@@ -0,0 +1,142 @@
+#include "ntdcp/relay-election.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <cstring>
+
+using namespace ntdcp;
+
+bool RelayElection::Neighbour::connected_to(uint64_t addr) const
+{
+    return std::find(neighbours.begin(), neighbours.end(), addr) != neighbours.end();
+}
+
+RelayElection::RelayElection(uint64_t own_addr) :
+    RelayElection(own_addr, Options())
+{
+}
+
+RelayElection::RelayElection(uint64_t own_addr, const Options& options) :
+    m_addr(own_addr), m_options(options)
+{
+}
+
+const RelayElection::Options& RelayElection::options() const
+{
+    return m_options;
+}
+
+Buffer::ptr RelayElection::make_hello(std::chrono::steady_clock::time_point now)
+{
+    forget_old(now);
+
+    size_t count = std::min<size_t>(m_neighbours.size(), std::numeric_limits<uint8_t>::max());
+    Buffer::ptr hello = Buffer::create_with_headroom(Buffer::default_headroom, 2 + count * sizeof(uint32_t));
+    uint8_t* p = hello->data();
+    *p++ = marked() ? 1 : 0;
+    *p++ = uint8_t(count);
+    for (auto it = m_neighbours.begin(); count != 0; ++it, count--)
+    {
+        uint32_t addr = uint32_t(it->first);
+        memcpy(p, &addr, sizeof(addr));
+        p += sizeof(addr);
+    }
+    return hello;
+}
+
+void RelayElection::process_hello(uint64_t source_addr, const Buffer::ptr& hello, std::chrono::steady_clock::time_point now)
+{
+    if (source_addr == m_addr || hello->size() < 2)
+        return;
+
+    const uint8_t* data = hello->data();
+    size_t count = std::min<size_t>(data[1], (hello->size() - 2) / sizeof(uint32_t));
+
+    Neighbour& neighbour = m_neighbours[source_addr];
+    neighbour.marked = data[0] & 1;
+    neighbour.updated = now;
+    neighbour.neighbours.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t addr;
+        memcpy(&addr, data + 2 + i * sizeof(addr), sizeof(addr));
+        neighbour.neighbours[i] = addr;
+    }
+}
+
+bool RelayElection::is_relay(std::chrono::steady_clock::time_point now)
+{
+    if (m_options.hello_period.count() == 0)
+        return true;
+
+    forget_old(now);
+    if (m_neighbours.empty())
+        return true;
+
+    return marked() && !pruned();
+}
+
+void RelayElection::forget_old(std::chrono::steady_clock::time_point now)
+{
+    for (auto it = m_neighbours.begin(); it != m_neighbours.end(); )
+    {
+        if (now - it->second.updated >= m_options.neighbour_timeout)
+            it = m_neighbours.erase(it);
+        else
+            ++it;
+    }
+}
+
+bool RelayElection::marked() const
+{
+    // Marked if two neighbours are not connected directly
+    for (auto u = m_neighbours.begin(); u != m_neighbours.end(); ++u)
+    {
+        for (auto w = std::next(u); w != m_neighbours.end(); ++w)
+        {
+            if (!u->second.connected_to(w->first) && !w->second.connected_to(u->first))
+                return true;
+        }
+    }
+    return false;
+}
+
+bool RelayElection::pruned() const
+{
+    // Only neighbours with bigger address may take the role, so two nodes never unmark each other
+    for (auto u = m_neighbours.begin(); u != m_neighbours.end(); ++u)
+    {
+        if (!u->second.marked || u->first < m_addr)
+            continue;
+
+        // Rule 1: closed neighbourhood is covered by one marked neighbour
+        if (u->second.connected_to(m_addr) && covered_by(&u->second, u->first, nullptr, 0))
+            return true;
+
+        // Rule 2: open neighbourhood is covered by two connected marked neighbours
+        for (auto w = std::next(u); w != m_neighbours.end(); ++w)
+        {
+            if (!w->second.marked || w->first < m_addr)
+                continue;
+            if (!u->second.connected_to(w->first) && !w->second.connected_to(u->first))
+                continue;
+            if (covered_by(&u->second, u->first, &w->second, w->first))
+                return true;
+        }
+    }
+    return false;
+}
+
+bool RelayElection::covered_by(const Neighbour* first, uint64_t first_addr, const Neighbour* second, uint64_t second_addr) const
+{
+    for (const auto& it : m_neighbours)
+    {
+        uint64_t addr = it.first;
+        if (addr == first_addr || first->connected_to(addr))
+            continue;
+        if (second && (addr == second_addr || second->connected_to(addr)))
+            continue;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,216 @@
+#include "ntdcp/routing.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <cstring>
+
+using namespace ntdcp;
+
+namespace
+{
+
+constexpr size_t advertisement_entry_size = sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint8_t) + sizeof(uint32_t);
+
+}
+
+bool RoutingTable::Route::advertised() const
+{
+    return cost != unreachable_cost;
+}
+
+RoutingTable::RoutingTable() :
+    RoutingTable(Options())
+{
+}
+
+RoutingTable::RoutingTable(const Options& options) :
+    m_options(options), m_routes(options.capacity)
+{
+}
+
+const RoutingTable::Options& RoutingTable::options() const
+{
+    return m_options;
+}
+
+void RoutingTable::learn(uint64_t source_addr, uint16_t package_id, size_t interface, uint8_t hop_limit_left,
+                         std::chrono::steady_clock::time_point now)
+{
+    if (!m_options.enabled)
+        return;
+
+    Route route;
+    route.interface = interface;
+    route.hop_limit_left = hop_limit_left;
+    route.package_id = package_id;
+    route.updated = now;
+
+    auto existing = m_routes.get_update(source_addr);
+    if (!existing.has_value())
+    {
+        m_routes.put_update(source_addr, route);
+        return;
+    }
+
+    Route& current = **existing;
+    if (!expired(current, now))
+    {
+        // Advertised routes are confirmed by advertisements only
+        if (current.advertised())
+            return;
+
+        // Another copy of the same package replaces the route only if it passed fewer relays
+        if (current.package_id == package_id)
+        {
+            if (current.interface == interface)
+            {
+                current.hop_limit_left = std::max(current.hop_limit_left, hop_limit_left);
+                current.updated = now;
+            }
+            if (hop_limit_left <= current.hop_limit_left)
+                return;
+        }
+    }
+    current = route;
+}
+
+std::optional<RoutingTable::Route> RoutingTable::find(uint64_t destination_addr, std::chrono::steady_clock::time_point now)
+{
+    if (!m_options.enabled)
+        return std::nullopt;
+
+    auto route = m_routes.get(destination_addr);
+    if (!route.has_value())
+        return std::nullopt;
+
+    if (expired(**route, now))
+    {
+        m_routes.erase(destination_addr);
+        return std::nullopt;
+    }
+    return **route;
+}
+
+uint8_t RoutingTable::hop_limit(uint64_t destination_addr, uint8_t requested, std::chrono::steady_clock::time_point now)
+{
+    auto route = find(destination_addr, now);
+    if (!route || !route->advertised() || route->hops == 0)
+        return requested;
+
+    size_t needed = size_t(route->hops) - 1 + m_options.hop_limit_margin;
+    return uint8_t(std::min<size_t>(requested, needed));
+}
+
+std::vector<Buffer::ptr> RoutingTable::make_advertisements(uint64_t own_addr, std::chrono::steady_clock::time_point now,
+                                                           size_t max_size)
+{
+    std::vector<Buffer::ptr> result;
+    Buffer::ptr current;
+    auto add_entry = [&](uint64_t addr, uint16_t cost, uint8_t hops, uint64_t next_hop) {
+        // Advertisement has at least one entry even if it does not fit
+        if (!current || current->data()[0] == std::numeric_limits<uint8_t>::max()
+            || (current->data()[0] != 0 && current->size() + advertisement_entry_size > max_size))
+        {
+            current = Buffer::create_with_headroom(Buffer::default_headroom, 1);
+            current->data()[0] = 0;
+            result.push_back(current);
+        }
+
+        uint8_t entry[advertisement_entry_size];
+        uint32_t addr_field = uint32_t(addr);
+        uint32_t next_hop_field = uint32_t(next_hop);
+        uint8_t* p = entry;
+        memcpy(p, &addr_field, sizeof(addr_field));
+        p += sizeof(addr_field);
+        memcpy(p, &cost, sizeof(cost));
+        p += sizeof(cost);
+        *p++ = hops;
+        memcpy(p, &next_hop_field, sizeof(next_hop_field));
+
+        current->put(entry, sizeof(entry));
+        current->data()[0]++;
+    };
+
+    add_entry(own_addr, 0, 0, own_addr);
+    m_routes.for_each([&](const uint64_t& addr, const Route& route) {
+        if (!route.advertised() || expired(route, now))
+            return;
+        add_entry(addr, route.cost, route.hops, route.next_hop);
+    });
+    return result;
+}
+
+void RoutingTable::process_advertisement(const Buffer::ptr& advertisement, uint64_t own_addr, uint64_t neighbour_addr,
+                                         size_t interface, uint16_t link_cost, std::chrono::steady_clock::time_point now)
+{
+    if (!m_options.enabled || advertisement->size() < 1)
+        return;
+
+    const uint8_t* data = advertisement->data();
+    size_t count = std::min<size_t>(data[0], (advertisement->size() - 1) / advertisement_entry_size);
+    const uint8_t* entry = data + 1;
+    for (size_t i = 0; i < count; i++, entry += advertisement_entry_size)
+    {
+        uint32_t addr, next_hop;
+        uint16_t cost;
+        const uint8_t* p = entry;
+        memcpy(&addr, p, sizeof(addr));
+        p += sizeof(addr);
+        memcpy(&cost, p, sizeof(cost));
+        p += sizeof(cost);
+        uint8_t hops = *p++;
+        memcpy(&next_hop, p, sizeof(next_hop));
+
+        // Route through this node would make a loop
+        if (addr == uint32_t(own_addr) || next_hop == uint32_t(own_addr) || hops == std::numeric_limits<uint8_t>::max())
+            continue;
+
+        uint32_t total_cost = uint32_t(cost) + link_cost;
+        if (total_cost >= unreachable_cost)
+            continue;
+
+        Route candidate;
+        candidate.interface = interface;
+        candidate.cost = uint16_t(total_cost);
+        candidate.hops = hops + 1;
+        candidate.next_hop = neighbour_addr;
+        candidate.updated = now;
+        advertised(addr, candidate, now);
+    }
+}
+
+void RoutingTable::advertised(uint64_t destination_addr, const Route& candidate, std::chrono::steady_clock::time_point now)
+{
+    auto existing = m_routes.get_update(destination_addr);
+    if (!existing.has_value())
+    {
+        m_routes.put_update(destination_addr, candidate);
+        return;
+    }
+
+    Route& route = **existing;
+    if (route.advertised() && !expired(route, now) && route.next_hop != candidate.next_hop)
+    {
+        // Other neighbour replaces the route only with better cost, the same one always updates it
+        if (candidate.cost > route.cost)
+            return;
+
+        if (candidate.cost == route.cost)
+        {
+            // Keep current route among equal ones, only refresh it
+            route.updated = now;
+            return;
+        }
+    }
+
+    uint8_t hop_limit_left = route.hop_limit_left;
+    uint16_t package_id = route.package_id;
+    route = candidate;
+    route.hop_limit_left = hop_limit_left;
+    route.package_id = package_id;
+}
+
+bool RoutingTable::expired(const Route& route, std::chrono::steady_clock::time_point now) const
+{
+    return now - route.updated >= m_options.route_timeout;
+}
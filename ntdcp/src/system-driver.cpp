@@ -1,5 +1,8 @@
 #include "ntdcp/system-driver.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 using namespace ntdcp;
 
 uint32_t SystemDriver::random_nonzero()
@@ -9,3 +12,40 @@ uint32_t SystemDriver::random_nonzero()
         result = random();
     return result;
 }
+
+ChannelLayer::Options PhysicalInterfaceOptions::channel_options() const
+{
+    ChannelLayer::Options result = channel;
+    if (reliable_framing)
+    {
+        result.framing = ChannelLayer::Framing::length_prefix;
+        result.checksum = Checksum::Type::none;
+        result.fec_parity = 0;
+    } else if (hardware_crc) {
+        result.checksum = Checksum::Type::none;
+    }
+
+    // Frame bigger than incoming buffer never completes, and its false header would block the stream
+    size_t limit = ChannelLayer::max_frame_size_for(result, size_t(std::max(ring_buffer_size, 0)));
+    if (limit != 0)
+        result.max_frame_size = std::min(result.max_frame_size, limit);
+    return result;
+}
+
+void IPhysicalInterface::send(const SegmentBuffer& data)
+{
+    if (data.segments().size() == 1)
+    {
+        send(*data.segments().begin());
+        return;
+    }
+
+    Buffer::ptr contiguous = Buffer::create(data.size());
+    uint8_t* p = contiguous->data();
+    for (const auto& seg : data.segments())
+    {
+        memcpy(p, seg->data(), seg->size());
+        p += seg->size();
+    }
+    send(contiguous);
+}
@@ -1,5 +1,7 @@
 #include "ntdcp/transport.hpp"
 
+#include <cstring>
+
 using namespace ntdcp;
 
 ConnectionId::ConnectionId(uint16_t destination_port, uint64_t source_addr, uint16_t source_port) :
@@ -47,6 +49,20 @@ ConnectionId SocketBase::incoming_connectiion_id()
     return ConnectionId(local_port(), remote_address(), remote_port());
 }
 
+TrafficClass SocketBase::traffic_class() const
+{
+    return m_options.traffic_class;
+}
+
+TrafficClass SocketBase::traffic_class(const TransportDescription& header) const
+{
+    // Pure acknowledgement has no message id
+    bool pure_ack = header.has_ack && header.message_id == 0;
+    if (header.type != TransportDescription::Type::data_transfer || pure_ack)
+        return TrafficClass::control;
+    return traffic_class();
+}
+
 SocketBase::~SocketBase()
 {
 }
@@ -95,7 +111,7 @@ void Acceptor::receive(Buffer::ptr data, const TransportDescription& header)
     }
 }
 
-std::optional<std::pair<TransportDescription, SegmentBuffer>> Acceptor::pick_outgoing()
+std::optional<std::pair<TransportDescription, SegmentBuffer>> Acceptor::pick_outgoing(bool)
 {
     return std::nullopt;
 }
@@ -334,7 +350,7 @@ void Socket::drop_if_timeout(std::chrono::steady_clock::time_point now)
     }
 }
 
-std::optional<std::pair<TransportDescription, SegmentBuffer>> Socket::pick_outgoing()
+std::optional<std::pair<TransportDescription, SegmentBuffer>> Socket::pick_outgoing(bool data_allowed)
 {
     if (m_state == State::connection_timeout)
     {
@@ -345,10 +361,12 @@ std::optional<std::pair<TransportDescription, SegmentBuffer>> Socket::pick_outgo
     auto now = m_transport_layer.system_driver()->now();
     drop_if_timeout(now);
 
-    if (!m_send_task)
+    bool data_waits = m_send_task && !data_allowed
+        && m_send_task->description.type == TransportDescription::Type::data_transfer;
+    if (!m_send_task || data_waits)
     {
-        // Nothing to send, but may be ack is waiting
-        if (!m_ack_task->was_sent_at_least_once
+        // Nothing to send or data waits, but may be ack is waiting
+        if (m_ack_task && !m_ack_task->was_sent_at_least_once
             && ((now - m_ack_task->time_seg_received > m_options.force_ack_after)
                 || m_ack_task->force_send_immediately))
         {
@@ -424,7 +442,7 @@ void TransportLayer::serve_incoming()
     {
         uint64_t source_addr = pkg->source_addr;
         Buffer::ptr pkg_data = pkg->data;
-        std::optional<std::pair<TransportDescription, Buffer::ptr>> p = decode(pkg_data->contents());
+        std::optional<std::pair<TransportDescription, Buffer::ptr>> p = decode(pkg_data);
         if (!p)
             continue;
 
@@ -463,13 +481,20 @@ void TransportLayer::serve_outgoing()
     {
         Socket* s = *it;
 
-        while (auto out = s->pick_outgoing())
+        // Data is not picked while network queues are standing, so retransmission timers are not
+        // spent on packages that would wait in the queue anyway. Acknowledgements and connection
+        // control are picked anyway, they are not delayed by the queues of data
+        for (;;)
         {
+            auto out = s->pick_outgoing(!m_network->congested(s->traffic_class()));
+            if (!out)
+                break;
+
             const TransportDescription& header = out->first;
             SegmentBuffer& seg_buf = out->second;
 
             encode(seg_buf, header);
-            m_network->send(seg_buf, s->remote_address());
+            m_network->send(std::move(seg_buf), s->remote_address(), NetworkLayer::default_hop_limit, s->traffic_class(header));
         }
     }
 }
@@ -522,23 +547,22 @@ Socket* TransportLayer::find_socket_for_submit(uint64_t source_addr, uint16_t ds
     return nullptr;
 }
 
-std::optional<std::pair<TransportDescription, Buffer::ptr>> TransportLayer::decode(MemBlock mem)
+std::optional<std::pair<TransportDescription, Buffer::ptr>> TransportLayer::decode(const Buffer::ptr& package)
 {
     // Trivial impl
+    MemBlock mem = package->contents();
     if (mem.size() < sizeof(TransportDescription))
         return std::nullopt;
 
     TransportDescription header;
     mem >> header;
-    return std::make_pair(header, Buffer::create(mem));
+    return std::make_pair(header, Buffer::slice(package, sizeof(TransportDescription)));
 }
 
 void TransportLayer::encode(SegmentBuffer& seg_buf, const TransportDescription& header)
 {
     // Trivial impl
-    auto b = Buffer::create();
-    b->raw() << header;
-    seg_buf.push_front(b);
+    memcpy(seg_buf.prepend(sizeof(header)), &header, sizeof(header));
 }
 
 
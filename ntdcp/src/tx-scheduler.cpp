@@ -0,0 +1,181 @@
+#include "ntdcp/tx-scheduler.hpp"
+
+#include <algorithm>
+
+using namespace ntdcp;
+
+TxScheduler::TxScheduler() :
+    TxScheduler(Options())
+{
+}
+
+TxScheduler::TxScheduler(const Options& options) :
+    m_options(options)
+{
+    for (auto& queue : m_queues)
+        queue.codel = CoDel(options.codel);
+}
+
+const TxScheduler::Options& TxScheduler::options() const
+{
+    return m_options;
+}
+
+bool TxScheduler::push(TrafficClass traffic_class, const SegmentBuffer& package, std::chrono::steady_clock::time_point now,
+                       bool replaceable)
+{
+    if (traffic_class == TrafficClass::control)
+    {
+        // Control queue grows while link is busy or down, the newest HELLOs and advertisements are the most useful.
+        // Acknowledgements and connection control are never lost silently
+        ClassQueue& control = m_queues[size_t(TrafficClass::control)];
+        if (control.items.size() >= std::max<size_t>(1, m_options.control_limit))
+        {
+            auto it = std::find_if(control.items.begin(), control.items.end(), [](const Item& item) { return item.replaceable; });
+            if (it == control.items.end())
+                return false;
+
+            m_bytes -= it->package.size();
+            m_size--;
+            control.items.erase(it);
+        }
+    } else if (full()) {
+        return false;
+    }
+
+    m_queues[size_t(traffic_class)].items.push_back(Item{package, now, replaceable});
+    m_size++;
+    m_bytes += package.size();
+    return true;
+}
+
+const SegmentBuffer* TxScheduler::peek(std::chrono::steady_clock::time_point now)
+{
+    for (;;)
+    {
+        m_selected = select();
+        if (!m_selected)
+            return nullptr;
+
+        ClassQueue& queue = m_queues[*m_selected];
+        const Item& head = queue.items.front();
+        if (queue.codel.should_drop(now - head.queued, now, queue.items.size() == 1))
+        {
+            m_bytes -= head.package.size();
+            remove_head(*m_selected);
+            continue;
+        }
+        return &head.package;
+    }
+}
+
+SegmentBuffer TxScheduler::pop()
+{
+    size_t index = *m_selected;
+    m_selected.reset();
+
+    ClassQueue& queue = m_queues[index];
+    SegmentBuffer package = std::move(queue.items.front().package);
+    m_bytes -= package.size();
+    remove_head(index);
+
+    if (index != size_t(TrafficClass::control))
+        queue.deficit -= std::min(queue.deficit, package.size());
+    return package;
+}
+
+bool TxScheduler::empty() const
+{
+    return m_size == 0;
+}
+
+bool TxScheduler::full() const
+{
+    return m_size - m_queues[size_t(TrafficClass::control)].items.size() >= m_options.limit;
+}
+
+size_t TxScheduler::size() const
+{
+    return m_size;
+}
+
+size_t TxScheduler::bytes() const
+{
+    return m_bytes;
+}
+
+std::optional<std::chrono::steady_clock::time_point> TxScheduler::oldest() const
+{
+    std::optional<std::chrono::steady_clock::time_point> result;
+    for (const auto& queue : m_queues)
+    {
+        if (!queue.items.empty() && (!result || queue.items.front().queued < *result))
+            result = queue.items.front().queued;
+    }
+    return result;
+}
+
+std::optional<std::chrono::steady_clock::time_point> TxScheduler::oldest(TrafficClass traffic_class) const
+{
+    const ClassQueue& queue = m_queues[size_t(traffic_class)];
+    if (queue.items.empty())
+        return std::nullopt;
+    return queue.items.front().queued;
+}
+
+std::optional<size_t> TxScheduler::select()
+{
+    if (!m_queues[size_t(TrafficClass::control)].items.empty())
+        return size_t(TrafficClass::control);
+
+    if (m_size == 0)
+        return std::nullopt;
+
+    // Deficit round robin. Every visit of not empty class adds quantum to its deficit,
+    // so the loop ends in a few rounds even for packages bigger than quantum
+    for (;;)
+    {
+        ClassQueue& queue = m_queues[m_current];
+        if (!queue.items.empty())
+        {
+            if (!m_quantum_added)
+            {
+                queue.deficit += quantum(m_current);
+                m_quantum_added = true;
+            }
+            if (queue.items.front().package.size() <= queue.deficit)
+                return m_current;
+        }
+
+        m_current = m_current + 1 < classes_count ? m_current + 1 : size_t(TrafficClass::interactive);
+        m_quantum_added = false;
+    }
+}
+
+size_t TxScheduler::quantum(size_t index) const
+{
+    size_t weight;
+    switch (TrafficClass(index))
+    {
+    case TrafficClass::interactive:
+        weight = m_options.interactive_weight;
+        break;
+    case TrafficClass::bulk:
+        weight = m_options.bulk_weight;
+        break;
+    default:
+        weight = m_options.forwarded_weight;
+    }
+    // Zero quantum would stop round robin forever
+    return std::max<size_t>(1, m_options.quantum * weight);
+}
+
+void TxScheduler::remove_head(size_t index)
+{
+    ClassQueue& queue = m_queues[index];
+    m_size--;
+    queue.items.pop_front();
+    // Empty class does not keep deficit for the future
+    if (queue.items.empty())
+        queue.deficit = 0;
+}
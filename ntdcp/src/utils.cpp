@@ -1,7 +1,14 @@
 #include "ntdcp/utils.hpp"
+#include "ntdcp/buffer-pool.hpp"
 
+#include <algorithm>
 #include <cstring>
 
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #define NTDCP_X86_SIMD
+    #include <immintrin.h>
+#endif
+
 using namespace ntdcp;
 
 // ---------------------------
@@ -12,12 +19,31 @@ bool SerialReadAccessor::empty() const
     return size() == 0;
 }
 
+size_t SerialReadAccessor::capacity() const
+{
+    return SIZE_MAX;
+}
+
 void SerialReadAccessor::extract(uint8_t* buf, size_t size)
 {
     get(buf, size);
     skip(size);
 }
 
+bool SerialReadAccessor::peek(size_t offset, void* buf, size_t size) const
+{
+    MemSpans spans = peek_spans(offset, size);
+    if (spans.size() != size)
+        return false;
+
+    uint8_t* dst = reinterpret_cast<uint8_t*>(buf);
+    if (spans.first.size() != 0)
+        memcpy(dst, spans.first.begin(), spans.first.size());
+    if (spans.second.size() != 0)
+        memcpy(dst + spans.first.size(), spans.second.begin(), spans.second.size());
+    return true;
+}
+
 Buffer::ptr SerialReadAccessor::extract_buf(size_t extraction_size)
 {
     extraction_size = std::min(extraction_size, size());
@@ -68,12 +94,12 @@ SerialWriteAccessor::RawStream SerialWriteAccessor::raw()
 
 Buffer::ptr Buffer::create(size_t size, const void* init_data)
 {
-    return std::shared_ptr<Buffer>(new Buffer(size, init_data));
+    return create_with_headroom(0, size, init_data);
 }
 
 Buffer::ptr Buffer::create(SerialReadAccessor& data, size_t size)
 {
-    Buffer::ptr result = create();
+    Buffer::ptr result = allocate(std::min(size, data.size()), 0);
     result->put(data, size);
     return result;
 }
@@ -85,28 +111,101 @@ Buffer::ptr Buffer::create(SerialReadAccessor& data)
 
 Buffer::ptr Buffer::create(const MemBlock& data)
 {
-    return std::shared_ptr<Buffer>(new Buffer(data.size(), data.begin()));
+    return create(data.size(), data.begin());
 }
 
 Buffer::ptr Buffer::create_from_string(const char* str)
 {
-    return std::shared_ptr<Buffer>(new Buffer(strlen(str)+1, str));
+    return create(strlen(str)+1, str);
 }
 
-Buffer::Buffer(size_t size, const void* init_data) :
-    m_contents(size)
+Buffer::ptr Buffer::create_with_headroom(size_t headroom, size_t size, const void* init_data)
+{
+    Buffer::ptr result = allocate(size, headroom);
+    result->put(init_data, size);
+    return result;
+}
+
+Buffer::ptr Buffer::slice(const ptr& parent, size_t offset, size_t size)
+{
+    offset = std::min(offset, parent->size());
+    size = std::min(size, parent->size() - offset);
+
+    Buffer::ptr result = allocate(0, 0);
+    // Slice of slice refers to the buffer that really owns memory
+    result->m_parent = parent->m_parent ? parent->m_parent : parent;
+    result->m_storage = parent->data() + offset;
+    // Parent memory is shared, so any growth (even after clear()) must reallocate first
+    result->m_capacity = 0;
+    result->m_size = size;
+    return result;
+}
+
+Buffer::ptr Buffer::allocate(size_t capacity, size_t headroom)
+{
+    BufferPool::Block tail;
+    BufferAllocator<Buffer> allocator(BufferPool::global(), headroom + capacity, &tail);
+    // Tail is filled by allocator before the constructor call
+    auto result = std::allocate_shared<Buffer>(allocator, PrivateTag(), nullptr, 0);
+    result->m_storage = reinterpret_cast<uint8_t*>(tail.data);
+    result->m_capacity = tail.size;
+    result->m_head = headroom;
+    return result;
+}
+
+Buffer::Buffer(PrivateTag, uint8_t* storage, size_t capacity) :
+    m_storage(storage), m_capacity(capacity)
 {
-    if (init_data != nullptr)
-    {
-        memcpy(m_contents.data(), init_data, size);
-    } else {
-        memset(m_contents.data(), 0, size);
-    }
+}
+
+Buffer::~Buffer()
+{
+    if (m_storage_detached)
+        BufferPool::deallocate(m_storage);
 }
 
 void Buffer::extend(size_t size)
 {
-    m_contents.resize(m_contents.size() + size);
+    if (m_head + m_size + size > m_capacity)
+        reallocate(m_head, std::max(m_size + size, 2 * m_size));
+    m_size += size;
+}
+
+void Buffer::reallocate(size_t headroom, size_t capacity)
+{
+    BufferPool::Block block = BufferPool::global().allocate(headroom + capacity);
+    uint8_t* storage = reinterpret_cast<uint8_t*>(block.data);
+    memcpy(storage + headroom, data(), m_size);
+    if (m_storage_detached)
+        BufferPool::deallocate(m_storage);
+
+    m_storage = storage;
+    m_capacity = block.size;
+    m_head = headroom;
+    m_storage_detached = true;
+    m_parent.reset();
+}
+
+uint8_t* Buffer::prepend(size_t size)
+{
+    if (m_head < size)
+        reallocate(size + default_headroom, m_size);
+
+    m_head -= size;
+    m_size += size;
+    return data();
+}
+
+size_t Buffer::headroom() const
+{
+    return m_head;
+}
+
+uint8_t* Buffer::append(size_t size)
+{
+    size_t old_size = m_size;
+    extend(size);
+    return data() + old_size;
 }
 
 Buffer::ptr Buffer::clone() const
@@ -117,27 +216,27 @@ Buffer::ptr Buffer::clone() const
 
 size_t Buffer::size() const
 {
-    return m_contents.size();
+    return m_size;
 }
 
 uint8_t* Buffer::data()
 {
-    return m_contents.data();
+    return m_storage + m_head;
 }
 
 const uint8_t* Buffer::data() const
 {
-    return m_contents.data();
+    return m_storage + m_head;
 }
 
 void Buffer::clear()
 {
-    m_contents.clear();
+    m_size = 0;
 }
 
 uint8_t& Buffer::at(size_t pos)
 {
-    return m_contents[pos];
+    return data()[pos];
 }
 
 uint8_t& Buffer::operator[](size_t pos)
@@ -147,12 +246,12 @@ uint8_t& Buffer::operator[](size_t pos)
 
 bool Buffer::operator==(const Buffer& right) const
 {
-    return m_contents == right.m_contents;
+    return contents() == right.contents();
 }
 
 MemBlock Buffer::contents() const
 {
-    return MemBlock(m_contents.data(), m_contents.size());
+    return MemBlock(data(), m_size);
 }
 
 bool Buffer::put(const void* data, size_t size)
@@ -160,14 +259,14 @@ bool Buffer::put(const void* data, size_t size)
     if (size == 0)
         return true;
 
-    size_t old_size = m_contents.size();
+    size_t old_size = m_size;
     extend(size);
 
     if (data != nullptr)
     {
-        memcpy(m_contents.data() + old_size, data, size);
+        memcpy(this->data() + old_size, data, size);
     } else {
-        memset(m_contents.data() + old_size, 0x00, size);
+        memset(this->data() + old_size, 0x00, size);
     }
     return true;
 }
@@ -181,9 +280,9 @@ bool Buffer::put(SerialReadAccessor& accessor, size_t size)
     if (buffer_size < size)
         size = buffer_size;
 
-    size_t old_size = m_contents.size();
+    size_t old_size = m_size;
     extend(size);
-    accessor.extract(m_contents.data() + old_size, size);
+    accessor.extract(data() + old_size, size);
     return true;
 }
 
@@ -201,6 +300,11 @@ RingBuffer::RingBuffer(size_t capacity) :
 {
 }
 
+size_t RingBuffer::capacity() const
+{
+    return m_contents.size() - 1;
+}
+
 size_t RingBuffer::free_space()
 {
     if (m_p_read <= m_p_write)
@@ -223,23 +327,12 @@ size_t RingBuffer::size() const
 
 bool RingBuffer::put(const void* src, size_t size)
 {
-    if (!will_fit(size))
+    WriteSpans spans = reserve(size);
+    if (spans.size() != size)
         return false;
 
-    const uint8_t* buf = (const uint8_t*) src;
-    size_t free_tail = m_contents.size() - m_p_write;
-    if (size < free_tail)
-    {
-        // Add to the end
-        memcpy(&m_contents[m_p_write], buf, size);
-        m_p_write += size;
-    } else {
-        // Part add to the end and part add to the beginning
-        memcpy(&m_contents[m_p_write], buf, free_tail);
-        uint32_t second_part_size = size - free_tail;
-        memcpy(&m_contents[0], &buf[free_tail], second_part_size);
-        m_p_write = second_part_size;
-    }
+    spans.write(0, src, size);
+    commit(size);
     return true;
 }
 
@@ -250,24 +343,34 @@ bool RingBuffer::put(Buffer::ptr buf)
 
 bool RingBuffer::put(SerialReadAccessor& accessor, size_t size)
 {
-    if (!will_fit(size))
+    WriteSpans spans = reserve(size);
+    if (spans.size() != size)
         return false;
 
+    accessor.extract(spans.first.data, spans.first.size);
+    accessor.extract(spans.second.data, spans.second.size);
+    commit(size);
+    return true;
+}
+
+WriteSpans RingBuffer::reserve(size_t size)
+{
+    if (!will_fit(size))
+        return WriteSpans();
+
     size_t free_tail = m_contents.size() - m_p_write;
     if (size < free_tail)
-    {
-        // Add to the end
-        accessor.extract(&m_contents[m_p_write], size);
-        m_p_write += size;
-    } else {
-        // Part add to the end and part add to the beginning
-        accessor.extract(&m_contents[m_p_write], free_tail);
-        uint32_t second_part_size = size - free_tail;
-        accessor.extract(&m_contents[0], second_part_size);
-        m_p_write = second_part_size;
-    }
+        return WriteSpans{{&m_contents[m_p_write], size}, {}};
 
-    return true;
+    return WriteSpans{{&m_contents[m_p_write], free_tail}, {&m_contents[0], size - free_tail}};
+}
+
+void RingBuffer::commit(size_t size)
+{
+    size = std::min(size, free_space());
+    m_p_write += size;
+    if (m_p_write >= m_contents.size())
+        m_p_write -= m_contents.size();
 }
 
 bool RingBuffer::will_fit(size_t size)
@@ -363,6 +466,139 @@ uint8_t& RingBuffer::operator[](size_t pos)
     return m_contents[target_pos];
 }
 
+MemSpans RingBuffer::peek_spans(size_t offset, size_t size) const
+{
+    size_t stored = this->size();
+    if (offset >= stored)
+        return MemSpans();
+
+    size = std::min(size, stored - offset);
+    size_t begin = m_p_read + offset;
+    if (begin >= m_contents.size())
+        begin -= m_contents.size();
+
+    size_t tail = m_contents.size() - begin;
+    if (size <= tail)
+        return MemSpans{MemBlock(&m_contents[begin], size), MemBlock()};
+
+    return MemSpans{MemBlock(&m_contents[begin], tail), MemBlock(&m_contents[0], size - tail)};
+}
+
+// ---------------------------
+// SpscRingBuffer
+
+SpscRingBuffer::SpscRingBuffer(size_t capacity)
+{
+    size_t rounded = 1;
+    while (rounded < capacity)
+        rounded <<= 1;
+
+    m_contents.resize(rounded);
+    m_mask = uint32_t(rounded - 1);
+}
+
+size_t SpscRingBuffer::capacity() const
+{
+    return m_contents.size();
+}
+
+size_t SpscRingBuffer::free_space() const
+{
+    uint32_t used = m_write.load(std::memory_order_relaxed) - m_read.load(std::memory_order_acquire);
+    return m_contents.size() - used;
+}
+
+size_t SpscRingBuffer::size() const
+{
+    return m_write.load(std::memory_order_acquire) - m_read.load(std::memory_order_relaxed);
+}
+
+bool SpscRingBuffer::put(const void* src, size_t size)
+{
+    WriteSpans spans = reserve(size);
+    if (spans.size() != size)
+        return false;
+
+    spans.write(0, src, size);
+    commit(size);
+    return true;
+}
+
+bool SpscRingBuffer::put(SerialReadAccessor& accessor, size_t size)
+{
+    size = std::min(size, accessor.size());
+    WriteSpans spans = reserve(size);
+    if (spans.size() != size)
+        return false;
+
+    accessor.extract(spans.first.data, spans.first.size);
+    accessor.extract(spans.second.data, spans.second.size);
+    commit(size);
+    return true;
+}
+
+WriteSpans SpscRingBuffer::reserve(size_t size)
+{
+    if (!will_fit(size))
+        return WriteSpans();
+
+    size_t begin = m_write.load(std::memory_order_relaxed) & m_mask;
+    size_t tail = m_contents.size() - begin;
+    if (size <= tail)
+        return WriteSpans{{&m_contents[begin], size}, {}};
+
+    return WriteSpans{{&m_contents[begin], tail}, {&m_contents[0], size - tail}};
+}
+
+void SpscRingBuffer::commit(size_t size)
+{
+    size = std::min(size, free_space());
+    uint32_t write = m_write.load(std::memory_order_relaxed);
+    m_write.store(write + uint32_t(size), std::memory_order_release);
+}
+
+bool SpscRingBuffer::will_fit(size_t size)
+{
+    return free_space() >= size;
+}
+
+bool SpscRingBuffer::get(uint8_t* buf, size_t size) const
+{
+    return peek(0, buf, size);
+}
+
+void SpscRingBuffer::skip(size_t size)
+{
+    uint32_t read = m_read.load(std::memory_order_relaxed);
+    size = std::min(size, this->size());
+    m_read.store(read + uint32_t(size), std::memory_order_release);
+}
+
+bool SpscRingBuffer::empty() const
+{
+    return size() == 0;
+}
+
+uint8_t SpscRingBuffer::operator[](size_t pos) const
+{
+    return m_contents[(m_read.load(std::memory_order_relaxed) + pos) & m_mask];
+}
+
+MemSpans SpscRingBuffer::peek_spans(size_t offset, size_t size) const
+{
+    size_t stored = this->size();
+    if (offset >= stored)
+        return MemSpans();
+
+    size = std::min(size, stored - offset);
+    size_t begin = (m_read.load(std::memory_order_relaxed) + offset) & m_mask;
+    size_t tail = m_contents.size() - begin;
+    if (size <= tail)
+        return MemSpans{MemBlock(&m_contents[begin], size), MemBlock()};
+
+    return MemSpans{MemBlock(&m_contents[begin], tail), MemBlock(&m_contents[0], size - tail)};
+}
+
 // ---------------------------
 // SegmentBuffer
 
@@ -372,67 +608,179 @@ SegmentBuffer::SegmentBuffer(Buffer::ptr buf)
         push_back(buf);
 }
 
+SegmentBuffer::SegmentBuffer(const SegmentBuffer& other)
+{
+    *this = other;
+}
+
+SegmentBuffer::SegmentBuffer(SegmentBuffer&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+SegmentBuffer& SegmentBuffer::operator=(const SegmentBuffer& other)
+{
+    if (this == &other)
+        return *this;
+
+    clear();
+    if (other.spilled())
+    {
+        m_spilled = other.m_spilled;
+    } else {
+        std::copy(other.m_inline, other.m_inline + other.m_count, m_inline);
+    }
+    m_count = other.m_count;
+    m_total_size = other.m_total_size;
+    return *this;
+}
+
+SegmentBuffer& SegmentBuffer::operator=(SegmentBuffer&& other) noexcept
+{
+    if (this == &other)
+        return *this;
+
+    clear();
+    if (other.spilled())
+    {
+        m_spilled = std::move(other.m_spilled);
+    } else {
+        std::move(other.m_inline, other.m_inline + other.m_count, m_inline);
+    }
+    m_count = other.m_count;
+    m_total_size = other.m_total_size;
+    other.clear();
+    return *this;
+}
+
 void SegmentBuffer::push_front(Buffer::ptr buf)
 {
-    m_segments.push_front(buf);
+    m_total_size += buf->size();
+    if (!spilled() && m_count < inline_segments)
+    {
+        std::move_backward(m_inline, m_inline + m_count, m_inline + m_count + 1);
+        m_inline[0] = std::move(buf);
+        m_count++;
+        return;
+    }
+
+    spill();
+    m_spilled.insert(m_spilled.begin(), std::move(buf));
+    m_count++;
 }
 
 void SegmentBuffer::push_back(Buffer::ptr buf)
 {
-    m_segments.push_back(buf);
+    m_total_size += buf->size();
+    if (!spilled() && m_count < inline_segments)
+    {
+        m_inline[m_count++] = std::move(buf);
+        return;
+    }
+
+    spill();
+    m_spilled.push_back(std::move(buf));
+    m_count++;
 }
 
-void SegmentBuffer::push_front(SegmentBuffer& buf)
+void SegmentBuffer::push_front(const SegmentBuffer& buf)
 {
-    for (auto it = buf.m_segments.rbegin(); it != buf.m_segments.rend(); --it)
+    const Buffer::ptr* segments = buf.data();
+    for (size_t i = buf.m_count; i != 0; i--)
     {
-        push_front(*it);
+        push_front(segments[i - 1]);
     }
 }
 
-void SegmentBuffer::push_back(SegmentBuffer& buf)
+void SegmentBuffer::push_back(const SegmentBuffer& buf)
 {
-    for (auto it = buf.m_segments.begin(); it != buf.m_segments.end(); ++it)
+    for (const auto& segment : buf.segments())
     {
-        push_back(*it);
+        push_back(segment);
     }
 }
 
+uint8_t* SegmentBuffer::prepend(size_t size)
+{
+    // Front buffer may be written only if nobody else sees it
+    Buffer::ptr* segments = data();
+    if (m_count == 0 || segments[0].use_count() != 1 || segments[0]->headroom() < size)
+    {
+        push_front(Buffer::create_with_headroom(Buffer::default_headroom));
+        segments = data();
+    }
+    m_total_size += size;
+    return segments[0]->prepend(size);
+}
+
 Buffer::ptr SegmentBuffer::merge()
 {
-    for (auto it = std::next(m_segments.begin()); it != m_segments.end(); it = m_segments.erase(it))
+    if (m_count == 0)
+        return Buffer::create();
+
+    Buffer::ptr front = data()[0];
+    for (size_t i = 1; i < m_count; i++)
     {
-        m_segments.front()->put((*it)->data(), (*it)->size());
+        const Buffer::ptr& segment = data()[i];
+        front->put(segment->data(), segment->size());
     }
-    return m_segments.front();
+    clear();
+    push_back(front);
+    return front;
 }
 
 bool SegmentBuffer::empty() const
 {
-    return m_segments.empty();
+    return m_count == 0;
 }
 
-const std::list<Buffer::ptr>& SegmentBuffer::segments()
+SegmentBuffer::Segments SegmentBuffer::segments() const
 {
-    return m_segments;
+    return Segments(data(), m_count);
 }
 
 size_t SegmentBuffer::size() const
 {
-    size_t total_size = 0;
-    for (const auto& segment : m_segments)
+    return m_total_size;
+}
+
+void SegmentBuffer::clear()
+{
+    for (size_t i = 0; i < inline_segments; i++)
     {
-        total_size += segment->size();
+        m_inline[i].reset();
     }
-    return total_size;
+    m_spilled.clear();
+    m_count = 0;
+    m_total_size = 0;
 }
 
-void SegmentBuffer::clear()
+Buffer::ptr* SegmentBuffer::data()
 {
-    m_segments.clear();
+    return spilled() ? m_spilled.data() : m_inline;
 }
 
+const Buffer::ptr* SegmentBuffer::data() const
+{
+    return spilled() ? m_spilled.data() : m_inline;
+}
 
+bool SegmentBuffer::spilled() const
+{
+    return !m_spilled.empty();
+}
+
+void SegmentBuffer::spill()
+{
+    if (spilled())
+        return;
+
+    m_spilled.reserve(2 * inline_segments);
+    for (size_t i = 0; i < m_count; i++)
+    {
+        m_spilled.push_back(std::move(m_inline[i]));
+    }
+}
 
 // ---------------------------
 // MemBlock
@@ -480,6 +828,14 @@ uint8_t MemBlock::operator[](size_t pos) const
     return m_begin[pos];
 }
 
+MemSpans MemBlock::peek_spans(size_t offset, size_t size) const
+{
+    if (offset >= this->size())
+        return MemSpans();
+
+    return MemSpans{MemBlock(m_begin + offset, std::min(size, this->size() - offset)), MemBlock()};
+}
+
 const uint8_t* MemBlock::begin() const
 {
     return m_begin;
@@ -502,6 +858,43 @@ bool MemBlock::operator==(const MemBlock& right) const
 }
 
 
+// ---------------------------
+// MemSpans
+
+size_t MemSpans::size() const
+{
+    return first.size() + second.size();
+}
+
+// ---------------------------
+// WriteSpans
+
+size_t WriteSpans::size() const
+{
+    return first.size + second.size;
+}
+
+bool WriteSpans::write(size_t offset, const void* src, size_t size)
+{
+    if (offset + size > this->size())
+        return false;
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(src);
+    if (offset < first.size)
+    {
+        size_t first_part = std::min(size, first.size - offset);
+        memcpy(first.data + offset, data, first_part);
+        data += first_part;
+        size -= first_part;
+        offset = 0;
+    } else {
+        offset -= first.size;
+    }
+    if (size != 0)
+        memcpy(second.data + offset, data, size);
+    return true;
+}
+
 // ---------------------------
 // BitExtractor
 
@@ -535,3 +928,156 @@ uint32_t ntdcp::hash_Ly(const void * buf, uint32_t size, uint32_t hash)
     return hash;
 }
 
+
+namespace
+{
+
+size_t find_u16_scalar(const uint8_t* data, size_t from, size_t size, uint8_t low, uint8_t high)
+{
+    for (size_t i = from; i + 1 < size; i++)
+    {
+        if (data[i] == low && data[i + 1] == high)
+            return i;
+    }
+    return size;
+}
+
+}
+
+size_t ntdcp::find_u16_impl::scalar(const uint8_t* data, size_t size, uint16_t value)
+{
+    return find_u16_scalar(data, 0, size, value & 0xFF, value >> 8);
+}
+
+size_t ntdcp::find_u16_impl::swar(const uint8_t* data, size_t size, uint16_t value)
+{
+    const uint8_t low = value & 0xFF;
+    const uint8_t high = value >> 8;
+    constexpr uint64_t ones = 0x0101010101010101ull;
+    constexpr uint64_t highs = 0x8080808080808080ull;
+    const uint64_t low_pattern = ones * low;
+    const uint64_t high_pattern = ones * high;
+
+    size_t i = 0;
+    // Word at i + 1 is read, so 9 bytes should be available
+    for (; i + 9 <= size; i += 8)
+    {
+        uint64_t first, second;
+        memcpy(&first, data + i, sizeof(first));
+        memcpy(&second, data + i + 1, sizeof(second));
+        first ^= low_pattern;
+        second ^= high_pattern;
+        // Byte is zero where pair matches. May give false positive above zero byte, so checking precisely
+        uint64_t zero_first = (first - ones) & ~first & highs;
+        uint64_t zero_second = (second - ones) & ~second & highs;
+        if (zero_first & zero_second)
+        {
+            size_t found = find_u16_scalar(data, i, i + 9, low, high);
+            if (found != i + 9)
+                return found;
+        }
+    }
+    return find_u16_scalar(data, i, size, low, high);
+}
+
+#ifdef NTDCP_X86_SIMD
+__attribute__((target("sse2")))
+size_t ntdcp::find_u16_impl::sse2(const uint8_t* data, size_t size, uint16_t value)
+{
+    const __m128i low = _mm_set1_epi8(char(value & 0xFF));
+    const __m128i high = _mm_set1_epi8(char(value >> 8));
+
+    size_t i = 0;
+    for (; i + 17 <= size; i += 16)
+    {
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1));
+        __m128i match = _mm_and_si128(_mm_cmpeq_epi8(first, low), _mm_cmpeq_epi8(second, high));
+        unsigned int mask = unsigned(_mm_movemask_epi8(match));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    return find_u16_scalar(data, i, size, value & 0xFF, value >> 8);
+}
+
+__attribute__((target("avx2")))
+size_t ntdcp::find_u16_impl::avx2(const uint8_t* data, size_t size, uint16_t value)
+{
+    const __m256i low = _mm256_set1_epi8(char(value & 0xFF));
+    const __m256i high = _mm256_set1_epi8(char(value >> 8));
+
+    size_t i = 0;
+    for (; i + 33 <= size; i += 32)
+    {
+        __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 1));
+        __m256i match = _mm256_and_si256(_mm256_cmpeq_epi8(first, low), _mm256_cmpeq_epi8(second, high));
+        unsigned int mask = unsigned(_mm256_movemask_epi8(match));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    return i + sse2(data + i, size - i, value);
+}
+
+bool ntdcp::find_u16_impl::sse2_supported()
+{
+    return __builtin_cpu_supports("sse2");
+}
+
+bool ntdcp::find_u16_impl::avx2_supported()
+{
+    return __builtin_cpu_supports("avx2");
+}
+#else
+size_t ntdcp::find_u16_impl::sse2(const uint8_t* data, size_t size, uint16_t value)
+{
+    return swar(data, size, value);
+}
+
+size_t ntdcp::find_u16_impl::avx2(const uint8_t* data, size_t size, uint16_t value)
+{
+    return swar(data, size, value);
+}
+
+bool ntdcp::find_u16_impl::sse2_supported()
+{
+    return false;
+}
+
+bool ntdcp::find_u16_impl::avx2_supported()
+{
+    return false;
+}
+#endif
+
+namespace
+{
+
+using FindU16Function = size_t (*)(const uint8_t* data, size_t size, uint16_t value);
+
+FindU16Function select_find_u16()
+{
+    if (find_u16_impl::avx2_supported())
+        return find_u16_impl::avx2;
+    if (find_u16_impl::sse2_supported())
+        return find_u16_impl::sse2;
+    return find_u16_impl::swar;
+}
+
+}
+
+size_t ntdcp::find_u16(const uint8_t* data, size_t size, uint16_t value)
+{
+    static const FindU16Function implementation = select_find_u16();
+    return implementation(data, size, value);
+}
+
+void ntdcp::find_all_u16(const uint8_t* data, size_t size, uint16_t value, std::vector<size_t>& positions)
+{
+    for (size_t i = find_u16(data, size, value); i < size; )
+    {
+        positions.push_back(i);
+        i++;
+        i += find_u16(data + i, size - i, value);
+    }
+}
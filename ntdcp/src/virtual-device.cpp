@@ -52,6 +52,11 @@ SerialReadAccessor& VirtualPhysicalInterface::incoming()
 }
 
 void VirtualPhysicalInterface::send(Buffer::ptr data)
+{
+    send(SegmentBuffer(data));
+}
+
+void VirtualPhysicalInterface::send(const SegmentBuffer& data)
 {
     m_last_tx = m_sys->now();
     m_medium->send(data, shared_from_this());
@@ -67,12 +72,23 @@ const PhysicalInterfaceOptions& VirtualPhysicalInterface::options() const
     return m_opts;
 }
 
-void VirtualPhysicalInterface::receive_from_medium(Buffer::ptr data)
+void VirtualPhysicalInterface::receive_from_medium(const SegmentBuffer& data)
 {
     if (m_sys->now() - m_last_tx < m_opts.tx_to_rx_time)
         return;
 
-    m_data.put(data);
+    // Frame is received completely or lost completely
+    WriteSpans spans = m_data.reserve(data.size());
+    if (spans.size() != data.size())
+        return;
+
+    size_t offset = 0;
+    for (const auto& seg : data.segments())
+    {
+        spans.write(offset, seg->data(), seg->size());
+        offset += seg->size();
+    }
+    m_data.commit(offset);
 }
 
 
@@ -81,7 +97,7 @@ void TransmissionMedium::add_client(std::shared_ptr<VirtualPhysicalInterface> cl
     m_clients.push_back(client);
 }
 
-void TransmissionMedium::send(Buffer::ptr data, std::shared_ptr<VirtualPhysicalInterface> sender)
+void TransmissionMedium::send(const SegmentBuffer& data, std::shared_ptr<VirtualPhysicalInterface> sender)
 {
     if (m_broken)
         return;
@@ -93,7 +109,7 @@ void TransmissionMedium::send(Buffer::ptr data, std::shared_ptr<VirtualPhysicalI
             if (client == sender)
                 continue;
 
-            client->receive_from_medium(data->clone());
+            client->receive_from_medium(data);
         } else {
             m_clients[i] = m_clients.back();
             m_clients.pop_back();
@@ -0,0 +1,84 @@
+#include "ntdcp/worker-pool.hpp"
+
+using namespace ntdcp;
+
+WorkerPool::WorkerPool(size_t threads_count)
+{
+    for (size_t i = 0; i < threads_count; i++)
+    {
+        m_threads.emplace_back([this] { worker(); });
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::unique_lock<std::mutex> lck(m_mutex);
+        m_stop = true;
+    }
+    m_work_cv.notify_all();
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+size_t WorkerPool::threads_count() const
+{
+    return m_threads.size();
+}
+
+void WorkerPool::run(size_t count, const std::function<void(size_t)>& task)
+{
+    if (m_threads.empty() || count <= 1)
+    {
+        for (size_t i = 0; i < count; i++)
+            task(i);
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lck(m_mutex);
+        m_task = &task;
+        m_count = count;
+        m_next = 0;
+        m_busy_workers = m_threads.size();
+        m_batch++;
+    }
+    m_work_cv.notify_all();
+
+    process();
+
+    std::unique_lock<std::mutex> lck(m_mutex);
+    m_done_cv.wait(lck, [this] { return m_busy_workers == 0; });
+    m_task = nullptr;
+}
+
+void WorkerPool::worker()
+{
+    uint64_t last_batch = 0;
+    std::unique_lock<std::mutex> lck(m_mutex);
+    for (;;)
+    {
+        m_work_cv.wait(lck, [this, last_batch] { return m_stop || m_batch != last_batch; });
+
+        if (m_stop)
+            return;
+
+        last_batch = m_batch;
+        lck.unlock();
+        process();
+        lck.lock();
+
+        if (--m_busy_workers == 0)
+            m_done_cv.notify_one();
+    }
+}
+
+void WorkerPool::process()
+{
+    for (size_t i = m_next.fetch_add(1); i < m_count; i = m_next.fetch_add(1))
+    {
+        (*m_task)(i);
+    }
+}
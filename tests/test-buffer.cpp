@@ -0,0 +1,443 @@
+#include "ntdcp/utils.hpp"
+#include "ntdcp/buffer-pool.hpp"
+#include "test-helpers.hpp"
+
+#include <gtest/gtest.h>
+#include <cstring>
+#include <thread>
+
+using namespace ntdcp;
+
+TEST(BufferPool, SizeClassesAndStatistics)
+{
+    BufferPool::Options opts;
+    opts.size_classes = {{64, 4, 2}, {512, 0, 2}};
+    BufferPool pool(opts);
+
+    BufferPool::Block small = pool.allocate(10);
+    EXPECT_EQ(small.size, 64);
+    BufferPool::Block big = pool.allocate(100);
+    EXPECT_EQ(big.size, 512);
+
+    auto stats = pool.statistics();
+    ASSERT_EQ(stats.size(), 2);
+    EXPECT_EQ(stats[0].blocks_total, 2);
+    EXPECT_EQ(stats[0].blocks_in_use, 1);
+    EXPECT_EQ(stats[1].blocks_in_use, 1);
+
+    BufferPool::deallocate(small.data);
+    BufferPool::deallocate(big.data);
+
+    stats = pool.statistics();
+    EXPECT_EQ(stats[0].blocks_in_use, 0);
+    EXPECT_EQ(stats[0].high_water, 1);
+
+    BufferPool::Block oversized = pool.allocate(1000);
+    EXPECT_EQ(oversized.size, 1000);
+    EXPECT_EQ(pool.oversized_allocations(), 1);
+    BufferPool::deallocate(oversized.data);
+}
+
+TEST(BufferPool, MemoryCeiling)
+{
+    BufferPool::Options opts;
+    opts.size_classes = {{64, 4, 2}};
+    BufferPool pool(opts);
+
+    std::vector<BufferPool::Block> blocks;
+    for (int i = 0; i < 6; i++)
+    {
+        blocks.push_back(pool.allocate(32));
+    }
+
+    auto stats = pool.statistics();
+    EXPECT_EQ(stats[0].blocks_total, 4);
+    EXPECT_EQ(stats[0].blocks_in_use, 4);
+    EXPECT_EQ(stats[0].high_water, 4);
+    EXPECT_EQ(stats[0].fallback_allocations, 2);
+
+    for (auto& block : blocks)
+    {
+        BufferPool::deallocate(block.data);
+    }
+    EXPECT_EQ(pool.statistics()[0].blocks_in_use, 0);
+}
+
+TEST(Buffer, PooledSteadyState)
+{
+    auto stats_before = BufferPool::global().statistics();
+    {
+        std::vector<Buffer::ptr> buffers;
+        for (int i = 0; i < 10; i++)
+        {
+            buffers.push_back(Buffer::create_from_string(test_string_1));
+        }
+    }
+    auto stats_warm = BufferPool::global().statistics();
+
+    for (int cycle = 0; cycle < 100; cycle++)
+    {
+        std::vector<Buffer::ptr> buffers;
+        for (int i = 0; i < 10; i++)
+        {
+            buffers.push_back(Buffer::create_from_string(test_string_1));
+        }
+    }
+    auto stats_after = BufferPool::global().statistics();
+
+    ASSERT_EQ(stats_before.size(), stats_after.size());
+    for (size_t i = 0; i < stats_after.size(); i++)
+    {
+        EXPECT_EQ(stats_warm[i].blocks_total, stats_after[i].blocks_total);
+        EXPECT_EQ(stats_before[i].blocks_in_use, stats_after[i].blocks_in_use);
+    }
+}
+
+TEST(Buffer, GrowsOutOfPoolBlock)
+{
+    Buffer::ptr buf = Buffer::create_from_string(test_string_1);
+    size_t initial_size = buf->size();
+
+    std::vector<uint8_t> big(5000, 0x5A);
+    buf->put(big.data(), big.size());
+
+    ASSERT_EQ(buf->size(), initial_size + big.size());
+    EXPECT_EQ(strcmp((const char*) buf->data(), test_string_1), 0);
+    EXPECT_EQ(0, memcmp(buf->data() + initial_size, big.data(), big.size()));
+
+    Buffer::ptr copy = buf->clone();
+    EXPECT_TRUE(*copy == *buf);
+}
+
+TEST(Buffer, PrependToHeadroom)
+{
+    Buffer::ptr buf = Buffer::create_with_headroom(16, strlen(test_string_1), test_string_1);
+    const uint8_t* payload = buf->data();
+    EXPECT_EQ(buf->headroom(), 16);
+
+    uint8_t* header = buf->prepend(4);
+    EXPECT_EQ(header + 4, payload);
+    EXPECT_EQ(buf->headroom(), 12);
+    memcpy(header, "HDR:", 4);
+
+    // Not enough headroom, contents are moved
+    memcpy(buf->prepend(20), "ANOTHER HEADER HERE:", 20);
+    std::string expected = std::string("ANOTHER HEADER HERE:HDR:") + test_string_1;
+    ASSERT_EQ(buf->size(), expected.size());
+    EXPECT_EQ(0, memcmp(buf->data(), expected.data(), expected.size()));
+    EXPECT_EQ(buf->headroom(), Buffer::default_headroom);
+}
+
+TEST(SegmentBuffer, PrependDoesNotTouchSharedBuffers)
+{
+    Buffer::ptr payload = Buffer::create_with_headroom(Buffer::default_headroom, strlen(test_string_1), test_string_1);
+
+    SegmentBuffer shared(payload);
+    memcpy(shared.prepend(3), "ab:", 3);
+    EXPECT_EQ(shared.segments().size(), 2);
+    EXPECT_EQ(payload->size(), strlen(test_string_1));
+
+    // Next headers go to the same header buffer
+    memcpy(shared.prepend(3), "cd:", 3);
+    EXPECT_EQ(shared.segments().size(), 2);
+
+    std::string expected = std::string("cd:ab:") + test_string_1;
+    Buffer::ptr merged = shared.merge();
+    ASSERT_EQ(merged->size(), expected.size());
+    EXPECT_EQ(0, memcmp(merged->data(), expected.data(), expected.size()));
+
+    SegmentBuffer exclusive(Buffer::create_with_headroom(Buffer::default_headroom, strlen(test_string_2), test_string_2));
+    exclusive.prepend(8);
+    exclusive.prepend(8);
+    EXPECT_EQ(exclusive.segments().size(), 1);
+    EXPECT_EQ(exclusive.size(), strlen(test_string_2) + 16);
+}
+
+TEST(Buffer, SliceKeepsParentAlive)
+{
+    Buffer::ptr parent = Buffer::create_from_string(test_string_2);
+    const uint8_t* parent_data = parent->data();
+
+    Buffer::ptr slice = Buffer::slice(parent, 5);
+    Buffer::ptr slice_of_slice = Buffer::slice(slice, 8, 6);
+    parent.reset();
+
+    ASSERT_EQ(slice->size(), strlen(test_string_2) + 1 - 5);
+    EXPECT_EQ(slice->data(), parent_data + 5);
+    EXPECT_EQ(strcmp((const char*) slice->data(), test_string_2 + 5), 0);
+
+    ASSERT_EQ(slice_of_slice->size(), 6);
+    EXPECT_EQ(slice_of_slice->data(), parent_data + 13);
+
+    // Extending slice makes its own copy
+    slice_of_slice->put("!", 1);
+    EXPECT_NE(slice_of_slice->data(), parent_data + 13);
+    EXPECT_EQ(0, memcmp(slice_of_slice->data(), "string!", 7));
+    EXPECT_EQ(strcmp((const char*) slice->data(), test_string_2 + 5), 0);
+
+    Buffer::ptr empty_slice = Buffer::slice(slice, 1000);
+    EXPECT_EQ(empty_slice->size(), 0);
+}
+
+TEST(Buffer, RefilledSliceDoesNotTouchParent)
+{
+    Buffer::ptr parent = Buffer::create_from_string(test_string_2);
+    Buffer::ptr slice = Buffer::slice(parent, 5, 6);
+
+    slice->clear();
+    slice->put("xxxxxx", 6);
+    EXPECT_EQ(0, memcmp(slice->data(), "xxxxxx", 6));
+    EXPECT_EQ(strcmp((const char*) parent->data(), test_string_2), 0);
+
+    Buffer::ptr other = Buffer::slice(parent, 0, 4);
+    other->clear();
+    memcpy(other->append(4), "yyyy", 4);
+    EXPECT_EQ(strcmp((const char*) parent->data(), test_string_2), 0);
+}
+
+TEST(SegmentBuffer, InlineAndSpilledSegments)
+{
+    SegmentBuffer sg;
+    std::string expected;
+    for (int i = 0; i < 10; i++)
+    {
+        std::string part = std::to_string(i) + ";";
+        if (i % 2 == 0)
+        {
+            sg.push_back(Buffer::create(part.size(), part.data()));
+            expected = expected + part;
+        } else {
+            sg.push_front(Buffer::create(part.size(), part.data()));
+            expected = part + expected;
+        }
+        ASSERT_EQ(sg.size(), expected.size());
+        ASSERT_EQ(sg.segments().size(), i + 1);
+    }
+
+    SegmentBuffer copy = sg;
+    SegmentBuffer moved = std::move(sg);
+    EXPECT_TRUE(sg.empty());
+    EXPECT_EQ(sg.size(), 0);
+    EXPECT_EQ(moved.size(), expected.size());
+
+    SegmentBuffer combined(Buffer::create_from_string(test_string_1));
+    combined.push_front(copy);
+    EXPECT_EQ(combined.segments().size(), 11);
+
+    Buffer::ptr merged = moved.merge();
+    ASSERT_EQ(merged->size(), expected.size());
+    EXPECT_EQ(0, memcmp(merged->data(), expected.data(), expected.size()));
+    EXPECT_EQ(moved.segments().size(), 1);
+    EXPECT_EQ(moved.size(), expected.size());
+}
+
+TEST(RingBuffer, PeekSpans)
+{
+    RingBuffer ring(16);
+    const char data[] = "0123456789ABCDEF";
+    ring.put(data, 12);
+    ring.skip(10);
+    ring.put(data, 10);
+
+    // Contents are "AB" + "0123456789", wrapped around the end of the ring
+    ASSERT_EQ(ring.size(), 12);
+    MemSpans spans = ring.peek_spans(0, 100);
+    EXPECT_EQ(spans.size(), 12);
+    EXPECT_EQ(spans.first.size(), 7);
+    EXPECT_EQ(0, memcmp(spans.first.begin(), "AB01234", 7));
+    EXPECT_EQ(0, memcmp(spans.second.begin(), "56789", 5));
+
+    spans = ring.peek_spans(8, 3);
+    EXPECT_EQ(spans.first.size(), 3);
+    EXPECT_EQ(spans.second.size(), 0);
+    EXPECT_EQ(0, memcmp(spans.first.begin(), "678", 3));
+
+    EXPECT_EQ(ring.peek_spans(12, 1).size(), 0);
+
+    uint32_t value = 0;
+    ASSERT_TRUE(ring.peek(5, &value, sizeof(value)));
+    EXPECT_EQ(0, memcmp(&value, "3456", 4));
+    EXPECT_FALSE(ring.peek(10, &value, sizeof(value)));
+}
+
+TEST(SpscRingBuffer, ProducerAndConsumerThreads)
+{
+    SpscRingBuffer ring(100);
+    ASSERT_EQ(ring.capacity(), 128);
+
+    const size_t total = 100000;
+    std::thread producer([&ring]()
+    {
+        uint8_t chunk[37];
+        size_t produced = 0;
+        while (produced < total)
+        {
+            size_t size = std::min(sizeof(chunk), total - produced);
+            for (size_t i = 0; i < size; i++)
+                chunk[i] = uint8_t(produced + i);
+
+            if (ring.put(chunk, size))
+                produced += size;
+            else
+                std::this_thread::yield();
+        }
+    });
+
+    size_t consumed = 0;
+    bool sequence_ok = true;
+    while (consumed < total)
+    {
+        MemSpans spans = ring.peek_spans(0, 50);
+        for (size_t i = 0; i < spans.size(); i++)
+        {
+            uint8_t byte = i < spans.first.size() ? spans.first[i] : spans.second[i - spans.first.size()];
+            sequence_ok = sequence_ok && (byte == uint8_t(consumed + i));
+        }
+        ring.skip(spans.size());
+        consumed += spans.size();
+        if (spans.size() == 0)
+            std::this_thread::yield();
+    }
+    producer.join();
+
+    EXPECT_TRUE(sequence_ok);
+    EXPECT_TRUE(ring.empty());
+}
+
+TEST(RingBuffer, ReserveAndCommit)
+{
+    RingBuffer ring(16);
+    const char data[] = "0123456789ABCDEF";
+    ring.put(data, 12);
+    ring.skip(12);
+
+    EXPECT_EQ(ring.reserve(17).size(), 0);
+
+    WriteSpans spans = ring.reserve(10);
+    ASSERT_EQ(spans.size(), 10);
+    EXPECT_EQ(spans.first.size, 5);
+    EXPECT_EQ(spans.second.size, 5);
+    ASSERT_TRUE(spans.write(0, "abc", 3));
+    ASSERT_TRUE(spans.write(3, "defghij", 7));
+    EXPECT_FALSE(spans.write(8, "xyz", 3));
+
+    // Not visible before commit
+    EXPECT_TRUE(ring.empty());
+    ring.commit(10);
+    ASSERT_EQ(ring.size(), 10);
+
+    char out[10];
+    ring.extract(reinterpret_cast<uint8_t*>(out), 10);
+    EXPECT_EQ(0, memcmp(out, "abcdefghij", 10));
+
+    SpscRingBuffer spsc(8);
+    WriteSpans spsc_spans = spsc.reserve(6);
+    ASSERT_EQ(spsc_spans.size(), 6);
+    spsc_spans.write(0, "qwerty", 6);
+    EXPECT_TRUE(spsc.empty());
+    spsc.commit(4);
+    EXPECT_EQ(spsc.size(), 4);
+    EXPECT_EQ(spsc[3], 'r');
+}
+
+TEST(FindU16, MatchesNaiveSearch)
+{
+    const uint16_t value = 0x00AB;
+    std::vector<uint8_t> data(300);
+    uint32_t rnd = 12345;
+    for (auto& byte : data)
+    {
+        rnd = rnd * 1664525 + 1013904223;
+        // Small alphabet to have many partial and full matches
+        const uint8_t alphabet[] = {0xAB, 0x00, 0x01, 0xAB};
+        byte = alphabet[(rnd >> 16) & 0x03];
+    }
+
+    for (size_t offset = 0; offset < 40; offset++)
+    {
+        for (size_t size = 0; size + offset <= data.size(); size += 7)
+        {
+            const uint8_t* begin = data.data() + offset;
+            std::vector<size_t> expected;
+            for (size_t i = 0; i + 1 < size; i++)
+            {
+                if (begin[i] == 0xAB && begin[i + 1] == 0x00)
+                    expected.push_back(i);
+            }
+
+            ASSERT_EQ(find_u16(begin, size, value), expected.empty() ? size : expected.front());
+
+            std::vector<size_t> found;
+            find_all_u16(begin, size, value, found);
+            ASSERT_EQ(found, expected);
+        }
+    }
+
+    std::vector<uint8_t> zeros(100, 0);
+    EXPECT_EQ(find_u16(zeros.data(), zeros.size(), value), zeros.size());
+    zeros[99] = 0xAB;
+    EXPECT_EQ(find_u16(zeros.data(), zeros.size(), value), zeros.size());
+    zeros[98] = 0xAB;
+    EXPECT_EQ(find_u16(zeros.data(), zeros.size(), value), zeros.size());
+    zeros[97] = 0xAB;
+    EXPECT_EQ(find_u16(zeros.data(), zeros.size(), value), zeros.size());
+    zeros[50] = 0xAB;
+    EXPECT_EQ(find_u16(zeros.data(), zeros.size(), value), 50);
+}
+
+TEST(FindU16, EveryKernelMatchesScalar)
+{
+    using Kernel = size_t (*)(const uint8_t* data, size_t size, uint16_t value);
+    std::vector<std::pair<const char*, Kernel>> kernels{
+        {"swar", find_u16_impl::swar}
+    };
+    if (find_u16_impl::sse2_supported())
+        kernels.emplace_back("sse2", find_u16_impl::sse2);
+    if (find_u16_impl::avx2_supported())
+        kernels.emplace_back("avx2", find_u16_impl::avx2);
+
+    const uint16_t value = 0x00AB;
+    std::vector<uint8_t> data(200);
+    uint32_t rnd = 54321;
+    for (auto& byte : data)
+    {
+        rnd = rnd * 1664525 + 1013904223;
+        const uint8_t alphabet[] = {0xAB, 0x00, 0x01, 0xAB};
+        byte = alphabet[(rnd >> 16) & 0x03];
+    }
+
+    for (const auto& kernel : kernels)
+    {
+        SCOPED_TRACE(kernel.first);
+
+        // Unaligned heads and tails of every length
+        for (size_t offset = 0; offset < 16; offset++)
+        {
+            for (size_t size = 0; size + offset <= 80; size++)
+            {
+                const uint8_t* begin = data.data() + offset;
+                ASSERT_EQ(kernel.second(begin, size, value), find_u16_impl::scalar(begin, size, value))
+                    << "offset " << offset << " size " << size;
+            }
+        }
+
+        // Single match at every position, including ones crossing 8-byte words and vector blocks
+        for (size_t offset = 0; offset < 8; offset++)
+        {
+            std::vector<uint8_t> buffer(offset + 70, 0x01);
+            uint8_t* begin = buffer.data() + offset;
+            const size_t size = buffer.size() - offset;
+            for (size_t pos = 0; pos + 1 < size; pos++)
+            {
+                begin[pos] = 0xAB;
+                begin[pos + 1] = 0x00;
+                ASSERT_EQ(kernel.second(begin, size, value), pos) << "offset " << offset << " pos " << pos;
+                // Only the low byte is left before the end
+                ASSERT_EQ(kernel.second(begin, pos + 1, value), pos + 1);
+                begin[pos] = 0x01;
+                begin[pos + 1] = 0x01;
+            }
+            EXPECT_EQ(kernel.second(begin, size, value), size);
+        }
+    }
+}
@@ -2,6 +2,11 @@
 
 #include "gtest/gtest.h"
 
+#include <list>
+#include <memory>
+#include <random>
+#include <algorithm>
+
 TEST(CachingSet, Operating)
 {
     CachingSet<int> cs(4);
@@ -54,3 +59,82 @@ TEST(CachingMap, Operating)
     ASSERT_TRUE(m.get(2).has_value());
     ASSERT_FALSE(m.get(3).has_value());
 }
+
+namespace
+{
+
+/// All keys fall into the same slot, so every operation walks probe sequences
+struct CollidingHash
+{
+    size_t operator()(int) const
+    {
+        return 0;
+    }
+};
+
+}
+
+TEST(CachingMap, EraseKeepsCollidingKeys)
+{
+    CachingMap<int, int, CollidingHash> m(8);
+    for (int i = 0; i < 8; i++)
+        ASSERT_FALSE(m.put_update(i, i * 10));
+
+    ASSERT_TRUE(m.erase(3));
+    ASSERT_FALSE(m.erase(3));
+    ASSERT_TRUE(m.erase(0));
+
+    for (int i = 0; i < 8; i++)
+    {
+        auto value = m.get(i);
+        if (i == 0 || i == 3)
+        {
+            ASSERT_FALSE(value.has_value());
+        } else {
+            ASSERT_TRUE(value.has_value());
+            ASSERT_EQ(**value, i * 10);
+        }
+    }
+
+    // Free entries are reused without displacing anything
+    ASSERT_FALSE(m.put_update(100, 1000));
+    ASSERT_FALSE(m.put_update(101, 1010));
+    for (int i : {1, 2, 4, 5, 6, 7, 100, 101})
+        ASSERT_TRUE(m.get(i).has_value());
+}
+
+TEST(CachingSet, MatchesReferenceLru)
+{
+    constexpr size_t capacity = 37;
+    CachingSet<uint16_t> cs(capacity);
+    std::list<uint16_t> reference;
+
+    std::mt19937 generator(1);
+    std::uniform_int_distribution<int> key(0, 120);
+    for (int i = 0; i < 20000; i++)
+    {
+        uint16_t k = uint16_t(key(generator));
+        auto it = std::find(reference.begin(), reference.end(), k);
+        bool existed = it != reference.end();
+        if (existed)
+            reference.erase(it);
+        else if (reference.size() == capacity)
+            reference.pop_front();
+        reference.push_back(k);
+
+        ASSERT_EQ(cs.check_update(k), existed) << "Iteration " << i;
+    }
+}
+
+TEST(CachingMap, ReleasesForgottenValues)
+{
+    auto value = std::make_shared<int>(5);
+    CachingMap<int, std::shared_ptr<int>> m(2);
+    m.put_update(1, value);
+    ASSERT_EQ(value.use_count(), 2);
+
+    m.put_update(2, nullptr);
+    m.put_update(3, nullptr);
+    ASSERT_FALSE(m.get(1).has_value());
+    ASSERT_EQ(value.use_count(), 1);
+}
@@ -1,6 +1,9 @@
 #include "ntdcp/channel.hpp"
+#include "ntdcp/system-driver.hpp"
+#include "ntdcp/buffer-pool.hpp"
 
 #include "gtest/gtest.h"
+#include <algorithm>
 
 using namespace ntdcp;
 
@@ -130,3 +133,457 @@ TEST(ChannelLayerBinaryClass, Corruption)
         ASSERT_EQ(0, memcmp(test_data_1, tmp, frames[0]->size()));
     }
 }
+
+TEST(ChannelLayerBinaryClass, SelectableChecksum)
+{
+    const char test_data[] = ">Whatever you want here<";
+    RingBuffer ring_buffer(200);
+
+    for (auto type : {Checksum::Type::crc32c, Checksum::Type::crc16})
+    {
+        ChannelLayer::Options opts;
+        opts.checksum = type;
+        ChannelLayer channel(opts);
+        ChannelLayer legacy_channel;
+
+        SegmentBuffer sg(Buffer::create(sizeof(test_data), test_data));
+        channel.encode(sg);
+        Buffer::ptr encoded = sg.merge();
+
+        ring_buffer.put(encoded);
+        auto frames = channel.decode(ring_buffer);
+        ASSERT_EQ(frames.size(), 1);
+        ASSERT_EQ(frames[0]->size(), sizeof(test_data));
+        EXPECT_EQ(0, memcmp(test_data, frames[0]->data(), sizeof(test_data)));
+
+        // Decoder with other checksum should not accept the frame
+        ring_buffer.put(encoded);
+        EXPECT_TRUE(legacy_channel.decode(ring_buffer).empty());
+        ring_buffer.clear();
+    }
+}
+
+TEST(ChannelLayerBinaryClass, ByteByByteStreaming)
+{
+    const char test_data[] = ">Whatever you want here<";
+    RingBuffer ring_buffer(200);
+    ChannelLayer channel;
+
+    SegmentBuffer sg(Buffer::create(sizeof(test_data), test_data));
+    channel.encode(sg);
+    Buffer::ptr encoded = sg.merge();
+
+    for (int round = 0; round < 3; round++)
+    {
+        for (size_t i = 0; i < encoded->size(); i++)
+        {
+            ring_buffer.put(encoded->data() + i, 1);
+            auto frames = channel.decode(ring_buffer);
+            if (i + 1 != encoded->size())
+            {
+                // Frame should not be emitted before its last byte
+                ASSERT_TRUE(frames.empty());
+                continue;
+            }
+            ASSERT_EQ(frames.size(), 1);
+            ASSERT_EQ(frames[0]->size(), sizeof(test_data));
+            EXPECT_EQ(0, memcmp(test_data, frames[0]->data(), sizeof(test_data)));
+        }
+        EXPECT_TRUE(ring_buffer.empty());
+    }
+}
+
+TEST(ChannelLayerBinaryClass, NoisyHeadersAreBounded)
+{
+    const char test_data[] = ">Whatever you want here<";
+    RingBuffer ring_buffer(1000);
+    ChannelLayer::Options opts;
+    opts.max_candidates = 4;
+    opts.max_frame_size = 200;
+    ChannelLayer channel(opts);
+
+    // Many false headers, which frames would end far away or are too big
+    ChannelHeader false_header;
+    false_header.size = 150;
+    for (int i = 0; i < 20; i++)
+        ring_buffer.put(&false_header, sizeof(false_header));
+
+    false_header.size = 10000;
+    ring_buffer.put(&false_header, sizeof(false_header));
+
+    SegmentBuffer sg(Buffer::create(sizeof(test_data), test_data));
+    channel.encode(sg);
+    ring_buffer.put(sg.merge());
+
+    // Only first candidates are tracked, false frames covering the real one are not resolved yet
+    EXPECT_TRUE(channel.decode(ring_buffer).empty());
+
+    // Following traffic resolves false candidates
+    std::vector<uint8_t> garbage(200, '#');
+    ring_buffer.put(garbage.data(), garbage.size());
+
+    auto frames = channel.decode(ring_buffer);
+    ASSERT_EQ(frames.size(), 1);
+    ASSERT_EQ(frames[0]->size(), sizeof(test_data));
+    EXPECT_EQ(0, memcmp(test_data, frames[0]->data(), sizeof(test_data)));
+}
+
+TEST(ChannelLayerBinaryClass, HeaderOnRingWrapAround)
+{
+    const char test_data[] = ">Whatever you want here<";
+    const char garbage[] = "#THIS IS A GARBAGE#";
+    RingBuffer ring_buffer(64);
+    ChannelLayer channel;
+
+    SegmentBuffer sg(Buffer::create(sizeof(test_data), test_data));
+    channel.encode(sg);
+    Buffer::ptr encoded = sg.merge();
+
+    // Every shift puts header at other position relative to ring end
+    for (size_t shift = 0; shift < 64; shift++)
+    {
+        std::vector<uint8_t> filler(shift % sizeof(garbage), '#');
+        ring_buffer.put(filler.data(), filler.size());
+        ring_buffer.put(encoded);
+
+        auto frames = channel.decode(ring_buffer);
+        ASSERT_EQ(frames.size(), 1);
+        ASSERT_EQ(frames[0]->size(), sizeof(test_data));
+        EXPECT_EQ(0, memcmp(test_data, frames[0]->data(), sizeof(test_data)));
+    }
+}
+
+TEST(ChannelLayerBinaryClass, ExtendedHeaderRejectsFalseHeaders)
+{
+    const char test_data[] = ">Whatever you want here<";
+    RingBuffer ring_buffer(200);
+    ChannelLayer::Options opts;
+    opts.extended_header = true;
+    opts.max_candidates = 1;
+    ChannelLayer channel(opts);
+
+    // False headers claim big frames but have wrong header checksum
+    ChannelExtendedHeader false_header;
+    false_header.size = 60000;
+    ring_buffer.put(&false_header, sizeof(false_header));
+    false_header.size = 150;
+    ring_buffer.put(&false_header, sizeof(false_header));
+
+    SegmentBuffer sg(Buffer::create(sizeof(test_data), test_data));
+    channel.encode(sg);
+    Buffer::ptr encoded = sg.merge();
+    ASSERT_EQ(encoded->size(), sizeof(ChannelExtendedHeader) + sizeof(test_data));
+    ring_buffer.put(encoded);
+
+    auto frames = channel.decode(ring_buffer);
+    ASSERT_EQ(frames.size(), 1);
+    ASSERT_EQ(frames[0]->size(), sizeof(test_data));
+    EXPECT_EQ(0, memcmp(test_data, frames[0]->data(), sizeof(test_data)));
+    EXPECT_TRUE(ring_buffer.empty());
+
+    // Decoder with legacy header should not accept the frame
+    ChannelLayer legacy_channel;
+    ring_buffer.put(encoded);
+    EXPECT_TRUE(legacy_channel.decode(ring_buffer).empty());
+}
+
+TEST(ChannelLayerCobs, EncodingAndResync)
+{
+    RingBuffer ring_buffer(2000);
+    ChannelLayer::Options opts;
+    opts.framing = ChannelLayer::Framing::cobs;
+    ChannelLayer channel(opts);
+
+    // Zeros, false magic numbers and long non-zero runs
+    std::vector<std::vector<uint8_t>> payloads{
+        {},
+        {0x00},
+        {0xAB, 0x00, 0x00, 0xAB, 0x00},
+        std::vector<uint8_t>(254, 0x11),
+        std::vector<uint8_t>(600, 0x22),
+        std::vector<uint8_t>(300, 0x00)
+    };
+    payloads[4][300] = 0;
+
+    std::vector<Buffer::ptr> encoded;
+    for (const auto& payload : payloads)
+    {
+        SegmentBuffer sg(Buffer::create(payload.size(), payload.data()));
+        channel.encode(sg);
+        Buffer::ptr frame = sg.merge();
+        // Only the delimiter may be zero
+        EXPECT_EQ(std::count(frame->data(), frame->data() + frame->size(), 0), 1);
+        EXPECT_EQ(frame->data()[frame->size() - 1], 0);
+        encoded.push_back(frame);
+    }
+
+    for (size_t i = 0; i < payloads.size(); i++)
+    {
+        ring_buffer.put(encoded[i]);
+        auto frames = channel.decode(ring_buffer);
+        ASSERT_EQ(frames.size(), 1);
+        ASSERT_EQ(frames[0]->size(), payloads[i].size());
+        EXPECT_TRUE(std::equal(payloads[i].begin(), payloads[i].end(), frames[0]->data()));
+    }
+
+    // Corrupted frame is dropped and next one is decoded immediately
+    Buffer::ptr corrupted = encoded[2]->clone();
+    corrupted->data()[3] ^= 0x10;
+    ring_buffer.put(corrupted);
+    ring_buffer.put(encoded[3]);
+    auto frames = channel.decode(ring_buffer);
+    ASSERT_EQ(frames.size(), 1);
+    EXPECT_EQ(frames[0]->size(), payloads[3].size());
+    EXPECT_TRUE(ring_buffer.empty());
+}
+
+TEST(ChannelLayerBinaryClass, ForwardErrorCorrection)
+{
+    std::vector<uint8_t> payload(600);
+    for (size_t i = 0; i < payload.size(); i++)
+        payload[i] = uint8_t(i * 7);
+
+    for (auto framing : {ChannelLayer::Framing::header, ChannelLayer::Framing::cobs})
+    {
+        RingBuffer ring_buffer(2000);
+        ChannelLayer::Options opts;
+        opts.framing = framing;
+        opts.fec_parity = 16;
+        ChannelLayer channel(opts);
+
+        SegmentBuffer sg(Buffer::create(100, payload.data()));
+        sg.push_back(Buffer::create(payload.size() - 100, payload.data() + 100));
+        channel.encode(sg);
+        Buffer::ptr encoded = sg.merge();
+
+        // Corrupt bytes in every FEC block, but not COBS code bytes or channel header
+        for (size_t pos = 20; pos + 10 < encoded->size(); pos += 50)
+            encoded->data()[pos] = encoded->data()[pos] == 0x01 ? 0x02 : 0x01;
+
+        ring_buffer.put(encoded);
+        auto frames = channel.decode(ring_buffer);
+        ASSERT_EQ(frames.size(), 1);
+        ASSERT_EQ(frames[0]->size(), payload.size());
+        EXPECT_TRUE(std::equal(payload.begin(), payload.end(), frames[0]->data()));
+    }
+}
+
+TEST(ChannelLayerBinaryClass, ContiguousOutput)
+{
+    const char test_data_1[] = ">Whatever you want here<";
+    const char test_data_2[] = ">Anything else<";
+    RingBuffer ring_buffer(200);
+    ChannelLayer::Options opts;
+    opts.contiguous_output = true;
+    ChannelLayer channel(opts);
+
+    SegmentBuffer sg(Buffer::create(sizeof(test_data_1), test_data_1));
+    sg.push_back(Buffer::create(sizeof(test_data_2), test_data_2));
+    channel.encode(sg);
+    ASSERT_EQ(sg.segments().size(), 1);
+
+    ring_buffer.put(sg.merge());
+    auto frames = channel.decode(ring_buffer);
+    ASSERT_EQ(frames.size(), 1);
+    ASSERT_EQ(frames[0]->size(), sizeof(test_data_1) + sizeof(test_data_2));
+    EXPECT_EQ(0, memcmp(test_data_1, frames[0]->data(), sizeof(test_data_1)));
+    EXPECT_EQ(0, memcmp(test_data_2, frames[0]->data() + sizeof(test_data_1), sizeof(test_data_2)));
+}
+
+TEST(ChannelLayerBinaryClass, NoChecksumTrustsFirstHeader)
+{
+    RingBuffer ring_buffer(200);
+    ChannelLayer::Options opts;
+    opts.checksum = Checksum::Type::none;
+    ChannelLayer channel(opts);
+
+    // Body contains a header of smaller frame that would end earlier
+    ChannelHeader inner_header;
+    inner_header.size = 2;
+    SegmentBuffer sg(Buffer::create(sizeof(inner_header), &inner_header));
+    sg.push_back(Buffer::create_from_string("Some data after inner header"));
+    const size_t body_size = sg.size();
+    channel.encode(sg);
+
+    for (int i = 0; i < 2; i++)
+        ring_buffer.put(sg.merge());
+
+    auto frames = channel.decode(ring_buffer);
+    ASSERT_EQ(frames.size(), 2);
+    EXPECT_EQ(frames[0]->size(), body_size);
+    EXPECT_EQ(frames[1]->size(), body_size);
+    EXPECT_TRUE(ring_buffer.empty());
+}
+
+TEST(ChannelLayerBinaryClass, LengthPrefixFraming)
+{
+    const char test_data[] = ">Whatever you want here<";
+    RingBuffer ring_buffer(200);
+    ChannelLayer::Options opts;
+    opts.framing = ChannelLayer::Framing::length_prefix;
+    ChannelLayer channel(opts);
+
+    SegmentBuffer sg(Buffer::create(sizeof(test_data), test_data));
+    channel.encode(sg);
+    Buffer::ptr encoded = sg.merge();
+    ASSERT_EQ(encoded->size(), sizeof(test_data) + sizeof(uint16_t));
+
+    // Frame is emitted only when it is fully received
+    ring_buffer.put(encoded->data(), 10);
+    EXPECT_TRUE(channel.decode(ring_buffer).empty());
+    ring_buffer.put(encoded->data() + 10, encoded->size() - 10);
+    ring_buffer.put(encoded);
+
+    auto frames = channel.decode(ring_buffer);
+    ASSERT_EQ(frames.size(), 2);
+    for (const auto& frame : frames)
+    {
+        ASSERT_EQ(frame->size(), sizeof(test_data));
+        EXPECT_EQ(0, memcmp(test_data, frame->data(), sizeof(test_data)));
+    }
+}
+
+TEST(ChannelLayerBinaryClass, LengthPrefixLimits)
+{
+    PhysicalInterfaceOptions phys_opts;
+    phys_opts.reliable_framing = true;
+    phys_opts.ring_buffer_size = 64;
+    ChannelLayer::Options opts = phys_opts.channel_options();
+    EXPECT_EQ(opts.max_frame_size, 64 - sizeof(uint16_t));
+
+    RingBuffer ring_buffer(phys_opts.ring_buffer_size);
+    ChannelLayer channel(opts);
+
+    // Frame that receiver could never accept is not encoded
+    std::vector<uint8_t> data(opts.max_frame_size + 1, '#');
+    SegmentBuffer oversized(Buffer::create(data.size(), data.data()));
+    EXPECT_FALSE(channel.encode(oversized));
+    EXPECT_EQ(oversized.size(), data.size());
+
+    // Size field limits frame even without ring buffer limits
+    ChannelLayer::Options default_opts;
+    default_opts.framing = ChannelLayer::Framing::length_prefix;
+    SegmentBuffer huge(Buffer::create(0x10000));
+    EXPECT_FALSE(ChannelLayer(default_opts).encode(huge));
+
+    // Size above the limit means that stream is desynchronized, buffered data is dropped
+    uint16_t false_size = uint16_t(opts.max_frame_size + 1);
+    ring_buffer.put(&false_size, sizeof(false_size));
+    ring_buffer.put(data.data(), 10);
+    EXPECT_TRUE(channel.decode(ring_buffer).empty());
+    EXPECT_TRUE(ring_buffer.empty());
+    EXPECT_EQ(channel.desync_count(), 1);
+
+    data.resize(opts.max_frame_size);
+    SegmentBuffer sg(Buffer::create(data.size(), data.data()));
+    ASSERT_TRUE(channel.encode(sg));
+    ring_buffer.put(sg.merge());
+    auto frames = channel.decode(ring_buffer);
+    ASSERT_EQ(frames.size(), 1);
+    EXPECT_EQ(frames[0]->size(), data.size());
+}
+
+TEST(ChannelLayerBinaryClass, OversizedFalseHeaderDoesNotBlockFullRing)
+{
+    PhysicalInterfaceOptions phys_opts;
+    phys_opts.ring_buffer_size = 64;
+    ChannelLayer::Options opts = phys_opts.channel_options();
+    EXPECT_EQ(opts.max_frame_size, 64 - sizeof(ChannelHeader));
+
+    RingBuffer ring_buffer(phys_opts.ring_buffer_size);
+    ChannelLayer channel(opts);
+
+    // False header of frame that could never fit the ring
+    ChannelHeader false_header;
+    false_header.size = 1000;
+    ring_buffer.put(&false_header, sizeof(false_header));
+
+    // Real frame is longer than free space after false header
+    std::vector<uint8_t> data(50, '#');
+    SegmentBuffer sg(Buffer::create(data.size(), data.data()));
+    channel.encode(sg);
+    Buffer::ptr encoded = sg.merge();
+    size_t first_part = ring_buffer.free_space();
+    ASSERT_LT(first_part, encoded->size());
+    ASSERT_TRUE(ring_buffer.put(encoded->data(), first_part));
+
+    // False header is dropped, so the rest of the frame fits
+    EXPECT_TRUE(channel.decode(ring_buffer).empty());
+    ASSERT_TRUE(ring_buffer.put(encoded->data() + first_part, encoded->size() - first_part));
+
+    auto frames = channel.decode(ring_buffer);
+    ASSERT_EQ(frames.size(), 1);
+    ASSERT_EQ(frames[0]->size(), data.size());
+    EXPECT_EQ(0, memcmp(data.data(), frames[0]->data(), data.size()));
+    EXPECT_TRUE(ring_buffer.empty());
+}
+
+TEST(ChannelLayerBinaryClass, LoneFalseHeaderDoesNotAllocateClaimedSize)
+{
+    const char test_data[] = ">Whatever you want here<";
+    RingBuffer ring_buffer(1000);
+    ChannelLayer channel;
+    size_t oversized_before = BufferPool::global().oversized_allocations();
+
+    // The only candidate claims a frame much bigger than any pool block
+    ChannelHeader false_header;
+    false_header.size = 60000;
+    ring_buffer.put(&false_header, sizeof(false_header));
+    std::vector<uint8_t> garbage(300, '#');
+    ring_buffer.put(garbage.data(), garbage.size());
+    EXPECT_TRUE(channel.decode(ring_buffer).empty());
+    EXPECT_EQ(BufferPool::global().oversized_allocations(), oversized_before);
+
+    // Real frame received by parts while false candidate is tracked
+    SegmentBuffer sg(Buffer::create(sizeof(test_data), test_data));
+    channel.encode(sg);
+    Buffer::ptr encoded = sg.merge();
+    std::vector<Buffer::ptr> frames;
+    for (size_t i = 0; i < encoded->size(); i += 5)
+    {
+        ring_buffer.put(encoded->data() + i, std::min<size_t>(5, encoded->size() - i));
+        auto decoded = channel.decode(ring_buffer);
+        frames.insert(frames.end(), decoded.begin(), decoded.end());
+    }
+    ASSERT_EQ(frames.size(), 1);
+    ASSERT_EQ(frames[0]->size(), sizeof(test_data));
+    EXPECT_EQ(0, memcmp(test_data, frames[0]->data(), sizeof(test_data)));
+    EXPECT_EQ(BufferPool::global().oversized_allocations(), oversized_before);
+}
+
+TEST(ChannelLayerCobs, ZeroFreeNoiseDoesNotStallFullRing)
+{
+    PhysicalInterfaceOptions phys_opts;
+    phys_opts.ring_buffer_size = 64;
+    phys_opts.channel.framing = ChannelLayer::Framing::cobs;
+    ChannelLayer::Options opts = phys_opts.channel_options();
+    // Body, checksum, COBS overhead and delimiter fit the ring
+    EXPECT_EQ(opts.max_frame_size, 58);
+
+    // Decoder with unlimited frame size relies only on ring capacity
+    for (const ChannelLayer::Options& options : {opts, ChannelLayer::Options(phys_opts.channel)})
+    {
+        RingBuffer ring_buffer(phys_opts.ring_buffer_size);
+        ChannelLayer channel(options);
+
+        std::vector<uint8_t> noise(ring_buffer.capacity(), 0xFF);
+        ASSERT_TRUE(ring_buffer.put(noise.data(), noise.size()));
+        EXPECT_TRUE(channel.decode(ring_buffer).empty());
+        EXPECT_TRUE(ring_buffer.empty());
+
+        // Noise tail before the next delimiter is dropped with it
+        std::vector<uint8_t> data(opts.max_frame_size, '#');
+        SegmentBuffer sg(Buffer::create(data.size(), data.data()));
+        channel.encode(sg);
+        Buffer::ptr encoded = sg.merge();
+        ASSERT_TRUE(ring_buffer.put(encoded->data(), encoded->size()));
+        EXPECT_TRUE(channel.decode(ring_buffer).empty());
+
+        ASSERT_TRUE(ring_buffer.put(encoded->data(), encoded->size()));
+        auto frames = channel.decode(ring_buffer);
+        ASSERT_EQ(frames.size(), 1);
+        ASSERT_EQ(frames[0]->size(), data.size());
+        EXPECT_EQ(0, memcmp(data.data(), frames[0]->data(), data.size()));
+        EXPECT_TRUE(ring_buffer.empty());
+    }
+}
@@ -0,0 +1,72 @@
+#include "ntdcp/checksum.hpp"
+#include "ntdcp/utils.hpp"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace ntdcp;
+
+TEST(Checksum, KnownValues)
+{
+    const char check_string[] = "123456789";
+    const size_t size = sizeof(check_string) - 1;
+
+    EXPECT_EQ(Checksum(Checksum::Type::crc32c).compute(check_string, size), 0xE3069283);
+    EXPECT_EQ(Checksum(Checksum::Type::crc32c, false).compute(check_string, size), 0xE3069283);
+    EXPECT_EQ(Checksum(Checksum::Type::crc16).compute(check_string, size), 0x29B1);
+    EXPECT_EQ(Checksum(Checksum::Type::legacy_hash).compute(check_string, size), hash_Ly(check_string, size));
+}
+
+TEST(Checksum, StreamingEqualsSinglePass)
+{
+    std::vector<uint8_t> data(1000);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = uint8_t(i * 7 + i / 13);
+
+    std::vector<Checksum> checksums{
+        Checksum(Checksum::Type::legacy_hash),
+        Checksum(Checksum::Type::crc32c),
+        Checksum(Checksum::Type::crc32c, false),
+        Checksum(Checksum::Type::crc16)
+    };
+
+    for (const auto& checksum : checksums)
+    {
+        uint32_t single_pass = checksum.compute(data.data(), data.size());
+
+        // Different split points to go through unaligned and tail branches
+        for (size_t split : {0, 1, 3, 7, 8, 13, 500, 999, 1000})
+        {
+            uint32_t state = checksum.begin();
+            state = checksum.update(state, data.data(), split);
+            state = checksum.update(state, data.data() + split, data.size() - split);
+            EXPECT_EQ(checksum.finish(state), single_pass) << "split at " << split;
+        }
+    }
+}
+
+TEST(Checksum, UpdateCopyEqualsUpdate)
+{
+    std::vector<uint8_t> data(1000);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = uint8_t(i * 11 + i / 7);
+
+    std::vector<Checksum> checksums{
+        Checksum(Checksum::Type::legacy_hash),
+        Checksum(Checksum::Type::crc32c),
+        Checksum(Checksum::Type::crc32c, false),
+        Checksum(Checksum::Type::crc16)
+    };
+
+    for (const auto& checksum : checksums)
+    {
+        for (size_t size : {0, 1, 5, 8, 12, 999, 1000})
+        {
+            std::vector<uint8_t> copy(size + 1, 0xEE);
+            uint32_t state = checksum.update_copy(checksum.begin(), copy.data() + 1, data.data(), size);
+            EXPECT_EQ(checksum.finish(state), checksum.compute(data.data(), size));
+            EXPECT_TRUE(std::equal(data.begin(), data.begin() + size, copy.begin() + 1));
+            EXPECT_EQ(copy[0], 0xEE);
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#include "ntdcp/codel.hpp"
+
+#include "gtest/gtest.h"
+
+using namespace ntdcp;
+using namespace std::chrono_literals;
+
+TEST(CoDel, ShortDelaysAreNotDropped)
+{
+    CoDel codel;
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+    for (int i = 0; i < 1000; i++)
+        ASSERT_FALSE(codel.should_drop(99ms, now + i * 10ms, false));
+}
+
+TEST(CoDel, StandingQueueIsDropped)
+{
+    CoDel::Options options;
+    options.target = 10ms;
+    options.interval = 100ms;
+    CoDel codel(options);
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+
+    // Delay above target is tolerated during interval
+    ASSERT_FALSE(codel.should_drop(20ms, now, false));
+    ASSERT_FALSE(codel.should_drop(20ms, now + 50ms, false));
+    ASSERT_FALSE(codel.dropping());
+
+    ASSERT_TRUE(codel.should_drop(20ms, now + 100ms, false));
+    ASSERT_TRUE(codel.dropping());
+
+    // Drops go faster and faster while queue is standing
+    int drops = 0;
+    for (int i = 1; i <= 100; i++)
+        drops += codel.should_drop(20ms, now + 100ms + i * 10ms, false) ? 1 : 0;
+    ASSERT_GT(drops, 10);
+
+    // The last package in the queue and short delay stop dropping
+    ASSERT_FALSE(codel.should_drop(20ms, now + 2s, true));
+    ASSERT_FALSE(codel.dropping());
+    ASSERT_FALSE(codel.should_drop(5ms, now + 3s, false));
+}
+
+TEST(CoDel, ZeroTargetDisablesDropping)
+{
+    CoDel::Options options;
+    options.target = 0ms;
+    CoDel codel(options);
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+    for (int i = 0; i < 100; i++)
+        ASSERT_FALSE(codel.should_drop(10s, now + i * 1s, false));
+}
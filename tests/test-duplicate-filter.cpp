@@ -0,0 +1,67 @@
+#include "ntdcp/duplicate-filter.hpp"
+
+#include "gtest/gtest.h"
+
+using namespace ntdcp;
+using namespace std::chrono_literals;
+
+TEST(DuplicateFilter, SameIdFromDifferentSources)
+{
+    DuplicateFilter filter;
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+
+    ASSERT_FALSE(filter.check_update(1, 100, now));
+    ASSERT_FALSE(filter.check_update(2, 100, now));
+    ASSERT_TRUE(filter.check_update(1, 100, now));
+    ASSERT_TRUE(filter.check_update(2, 100, now));
+    ASSERT_FALSE(filter.check_update(1, 101, now));
+}
+
+TEST(DuplicateFilter, IdIsForgottenAfterWindow)
+{
+    DuplicateFilter::Options options;
+    options.window = 100ms;
+    DuplicateFilter filter(options);
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+
+    ASSERT_FALSE(filter.check_update(1, 5, now));
+    ASSERT_TRUE(filter.check_update(1, 5, now + 99ms));
+    ASSERT_FALSE(filter.check_update(1, 5, now + 100ms));
+    ASSERT_TRUE(filter.check_update(1, 5, now + 150ms));
+}
+
+TEST(DuplicateFilter, CapacityFollowsPackagesRate)
+{
+    DuplicateFilter::Options options;
+    options.window = 1000ms;
+    options.initial_capacity = 10;
+    options.max_capacity = 64;
+    DuplicateFilter filter(options);
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+
+    // 10 packages per second fit initial capacity
+    for (int i = 0; i < 100; i++)
+        ASSERT_FALSE(filter.check_update(1, uint16_t(i), now + i * 100ms));
+    ASSERT_EQ(filter.capacity(), 10u);
+
+    // 40 packages per second need more space and all of them are still detected
+    auto burst = now + 20s;
+    for (int i = 0; i < 40; i++)
+        ASSERT_FALSE(filter.check_update(2, uint16_t(i), burst + i * 25ms));
+    ASSERT_GE(filter.capacity(), 40u);
+    for (int i = 0; i < 40; i++)
+        ASSERT_TRUE(filter.check_update(2, uint16_t(i), burst + 999ms));
+
+    // Growth is bounded
+    for (int i = 0; i < 1000; i++)
+        filter.check_update(3, uint16_t(i), burst + 1s);
+    ASSERT_EQ(filter.capacity(), 64u);
+
+    // 2 packages per second let capacity return to the initial one, window by window
+    auto calm = burst + 2s;
+    for (int i = 0; i < 20; i++)
+        ASSERT_FALSE(filter.check_update(4, uint16_t(i), calm + i * 500ms));
+    ASSERT_EQ(filter.capacity(), 10u);
+    for (int i = 18; i < 20; i++)
+        ASSERT_TRUE(filter.check_update(4, uint16_t(i), calm + 9999ms));
+}
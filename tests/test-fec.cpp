@@ -0,0 +1,77 @@
+#include "ntdcp/fec.hpp"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace ntdcp;
+
+namespace
+{
+
+std::vector<uint8_t> make_data(size_t size, uint32_t seed)
+{
+    std::vector<uint8_t> data(size);
+    for (auto& byte : data)
+    {
+        seed = seed * 1664525 + 1013904223;
+        byte = uint8_t(seed >> 24);
+    }
+    return data;
+}
+
+}
+
+TEST(ReedSolomon, EncodedSize)
+{
+    ReedSolomon rs(16);
+    EXPECT_EQ(rs.data_block_size(), 239);
+    EXPECT_EQ(rs.encoded_size(0), 0);
+    EXPECT_EQ(rs.encoded_size(1), 17);
+    EXPECT_EQ(rs.encoded_size(239), 255);
+    EXPECT_EQ(rs.encoded_size(240), 272);
+}
+
+TEST(ReedSolomon, CorrectsUpToHalfOfParity)
+{
+    for (size_t parity : {2, 8, 16, 32})
+    {
+        ReedSolomon rs(parity);
+        for (size_t size : {1, 10, 100, 239, 500})
+        {
+            std::vector<uint8_t> data = make_data(size, uint32_t(size + parity));
+            std::vector<uint8_t> encoded(rs.encoded_size(size));
+            rs.encode(data.data(), size, encoded.data());
+
+            // Every block gets parity / 2 errors
+            uint32_t seed = 7;
+            for (size_t block = 0; block < encoded.size(); block += ReedSolomon::block_size)
+            {
+                size_t block_size = std::min(encoded.size() - block, ReedSolomon::block_size);
+                for (size_t i = 0; i < parity / 2; i++)
+                {
+                    seed = seed * 1664525 + 1013904223;
+                    encoded[block + (seed >> 8) % block_size] ^= uint8_t(seed >> 24) | 1;
+                }
+            }
+
+            auto decoded_size = rs.decode(encoded.data(), encoded.size());
+            ASSERT_TRUE(decoded_size) << "parity " << parity << ", size " << size;
+            ASSERT_EQ(*decoded_size, size);
+            EXPECT_TRUE(std::equal(data.begin(), data.end(), encoded.begin()));
+        }
+    }
+}
+
+TEST(ReedSolomon, DetectsTooManyErrors)
+{
+    ReedSolomon rs(8);
+    std::vector<uint8_t> data = make_data(100, 1);
+    std::vector<uint8_t> encoded(rs.encoded_size(data.size()));
+    rs.encode(data.data(), data.size(), encoded.data());
+
+    for (size_t i = 0; i < 20; i++)
+        encoded[i * 5] ^= 0x5A;
+
+    auto decoded_size = rs.decode(encoded.data(), encoded.size());
+    EXPECT_FALSE(decoded_size && std::equal(data.begin(), data.end(), encoded.begin()));
+}
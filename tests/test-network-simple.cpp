@@ -2,6 +2,7 @@
 #include "ntdcp/virtual-device.hpp"
 #include "test-helpers.hpp"
 #include <gtest/gtest.h>
+#include <set>
 
 using namespace ntdcp;
 using namespace std::literals::chrono_literals;
@@ -46,6 +47,27 @@ protected:
     std::map<uint64_t, std::shared_ptr<NetworkLayer>> networks;
 };
 
+namespace {
+
+/// Advertisement of count routes to addresses from first_addr, all behind next_hop
+Buffer::ptr make_advertisement(uint32_t first_addr, uint8_t count, uint32_t next_hop)
+{
+    Buffer::ptr result = Buffer::create(1);
+    result->data()[0] = count;
+    for (uint32_t addr = first_addr; addr < first_addr + count; addr++)
+    {
+        uint16_t cost = 1;
+        uint8_t hops = 1;
+        result->put(&addr, sizeof(addr));
+        result->put(&cost, sizeof(cost));
+        result->put(&hops, sizeof(hops));
+        result->put(&next_hop, sizeof(next_hop));
+    }
+    return result;
+}
+
+}
+
 TEST_F(NetworkTest, TwoPointsWired)
 {
     add_net_user(123);
@@ -90,3 +112,619 @@ TEST_F(NetworkTest, TwoPointsWired)
 }
 
 
+
+TEST(VirtualPhysicalInterface, GatherSend)
+{
+    auto medium = std::make_shared<TransmissionMedium>();
+    auto sys = std::make_shared<SystemDriverDeterministic>();
+    auto phys1 = VirtualPhysicalInterface::create(PhysicalInterfaceOptions(), sys, medium);
+    auto phys2 = VirtualPhysicalInterface::create(PhysicalInterfaceOptions(), sys, medium);
+
+    SegmentBuffer frame(Buffer::create_from_string(test_string_2));
+    frame.push_front(Buffer::create_from_string(test_string_1));
+    frame.push_back(Buffer::create_from_string(test_string_3));
+    phys1->send(frame);
+
+    EXPECT_TRUE(phys1->incoming().empty());
+
+    SerialReadAccessor& inc = phys2->incoming();
+    ASSERT_EQ(inc.size(), frame.size());
+
+    Buffer::ptr received = inc.extract_buf();
+    Buffer::ptr expected = frame.merge();
+    EXPECT_TRUE(*received == *expected);
+}
+
+TEST_F(NetworkTest, CobsFramingInterfaces)
+{
+    PhysicalInterfaceOptions opts;
+    opts.channel.framing = ChannelLayer::Framing::cobs;
+    opts.channel.checksum = Checksum::Type::crc32c;
+    add_net_user(123, opts);
+    add_net_user(321, opts);
+
+    networks[123]->send(Buffer::create_from_string(test_string_1), 321);
+    serve_all_nets();
+    auto in = networks[321]->incoming();
+    ASSERT_TRUE(in);
+    EXPECT_EQ(in->source_addr, 123);
+    EXPECT_EQ(strcmp((const char*) in->data->data(), test_string_1), 0);
+}
+
+TEST_F(NetworkTest, ParallelDecodingOnSeveralInterfaces)
+{
+    NetworkLayer::Options net_opts;
+    net_opts.rx_worker_threads = 2;
+    auto gateway = std::make_shared<NetworkLayer>(sys, 1, net_opts);
+
+    std::vector<std::shared_ptr<NetworkLayer>> senders;
+    for (uint64_t addr = 10; addr < 14; addr++)
+    {
+        auto link = std::make_shared<TransmissionMedium>();
+        auto gateway_phys = VirtualPhysicalInterface::create(PhysicalInterfaceOptions(), sys, link);
+        auto sender_phys = VirtualPhysicalInterface::create(PhysicalInterfaceOptions(), sys, link);
+        gateway->add_physical(gateway_phys);
+        auto sender = std::make_shared<NetworkLayer>(sys, addr);
+        sender->add_physical(sender_phys);
+        senders.push_back(sender);
+    }
+
+    for (auto& sender : senders)
+    {
+        sender->send(Buffer::create_from_string(test_string_1), 1);
+        sender->serve();
+    }
+    gateway->serve();
+
+    std::set<uint64_t> sources;
+    while (auto in = gateway->incoming())
+    {
+        EXPECT_EQ(strcmp((const char*) in->data->data(), test_string_1), 0);
+        sources.insert(in->source_addr);
+    }
+    EXPECT_EQ(sources, std::set<uint64_t>({10, 11, 12, 13}));
+}
+
+TEST_F(NetworkTest, AggregatedFrames)
+{
+    auto det_sys = std::static_pointer_cast<SystemDriverDeterministic>(sys);
+    PhysicalInterfaceOptions opts;
+    opts.aggregation = true;
+    opts.aggregation_hold_time = 10ms;
+    opts.aggregation_max_size = 128;
+    add_net_user(123, opts);
+    add_net_user(321, opts);
+
+    const char* strings[] = {test_string_1, test_string_2, test_string_3};
+    for (const char* str : strings)
+        networks[123]->send(Buffer::create_from_string(str), 321);
+
+    // Packages are held for more packages
+    serve_all_nets();
+    EXPECT_FALSE(networks[321]->incoming());
+
+    det_sys->increment_time(10ms);
+    serve_all_nets();
+
+    size_t received = 0;
+    while (auto in = networks[321]->incoming())
+    {
+        ASSERT_LT(received, 3);
+        EXPECT_EQ(in->source_addr, 123);
+        EXPECT_EQ(strcmp((const char*) in->data->data(), strings[received]), 0);
+        received++;
+    }
+    EXPECT_EQ(received, 3);
+}
+
+TEST(PhysicalInterfaceOptions, IntegrityCapabilities)
+{
+    PhysicalInterfaceOptions reliable;
+    reliable.reliable_framing = true;
+    EXPECT_EQ(reliable.channel_options().framing, ChannelLayer::Framing::length_prefix);
+    EXPECT_EQ(reliable.channel_options().checksum, Checksum::Type::none);
+
+    PhysicalInterfaceOptions hardware_crc;
+    hardware_crc.hardware_crc = true;
+    hardware_crc.channel.checksum = Checksum::Type::crc32c;
+    EXPECT_EQ(hardware_crc.channel_options().framing, ChannelLayer::Framing::header);
+    EXPECT_EQ(hardware_crc.channel_options().checksum, Checksum::Type::none);
+}
+
+TEST_F(NetworkTest, ReliableFramingInterfaces)
+{
+    PhysicalInterfaceOptions opts;
+    opts.reliable_framing = true;
+    add_net_user(123, opts);
+    add_net_user(321, opts);
+
+    networks[123]->send(Buffer::create_from_string(test_string_1), 321);
+    serve_all_nets();
+    auto in = networks[321]->incoming();
+    ASSERT_TRUE(in);
+    EXPECT_EQ(in->source_addr, 123);
+    EXPECT_EQ(strcmp((const char*) in->data->data(), test_string_1), 0);
+}
+
+TEST_F(NetworkTest, HardwareCrcInterfaces)
+{
+    PhysicalInterfaceOptions opts;
+    opts.hardware_crc = true;
+    opts.channel.checksum = Checksum::Type::crc32c;
+    add_net_user(123, opts);
+    add_net_user(321, opts);
+
+    networks[123]->send(Buffer::create_from_string(test_string_1), 321);
+    serve_all_nets();
+    auto in = networks[321]->incoming();
+    ASSERT_TRUE(in);
+    EXPECT_EQ(in->source_addr, 123);
+    EXPECT_EQ(strcmp((const char*) in->data->data(), test_string_1), 0);
+}
+
+TEST_F(NetworkTest, LearnedRoutesAvoidFlooding)
+{
+    // Leaves connected to the hub by separate links
+    auto hub = std::make_shared<NetworkLayer>(sys, 1);
+    std::map<uint64_t, std::shared_ptr<NetworkLayer>> leaves;
+    std::map<uint64_t, std::shared_ptr<VirtualPhysicalInterface>> leaf_physicals;
+    for (uint64_t addr = 10; addr < 13; addr++)
+    {
+        auto link = std::make_shared<TransmissionMedium>();
+        hub->add_physical(VirtualPhysicalInterface::create(PhysicalInterfaceOptions(), sys, link));
+        leaf_physicals[addr] = VirtualPhysicalInterface::create(PhysicalInterfaceOptions(), sys, link);
+        leaves[addr] = std::make_shared<NetworkLayer>(sys, addr);
+        leaves[addr]->add_physical(leaf_physicals[addr]);
+    }
+
+    // Destination is unknown, so the first package is flooded to all leaves
+    leaves[10]->send(Buffer::create_from_string(test_string_1), 11);
+    leaves[10]->serve();
+    hub->serve();
+    ASSERT_FALSE(leaf_physicals[11]->incoming().empty());
+    ASSERT_FALSE(leaf_physicals[12]->incoming().empty());
+    leaves[11]->serve();
+    leaves[12]->serve();
+    auto in = leaves[11]->incoming();
+    ASSERT_TRUE(in);
+    EXPECT_EQ(in->source_addr, 10);
+    EXPECT_FALSE(leaves[12]->incoming());
+
+    // Answer goes only to the leaf the hub learned from the first package
+    leaves[11]->send(Buffer::create_from_string(test_string_2), 10);
+    leaves[11]->serve();
+    hub->serve();
+    ASSERT_FALSE(leaf_physicals[10]->incoming().empty());
+    ASSERT_TRUE(leaf_physicals[12]->incoming().empty());
+    leaves[10]->serve();
+    in = leaves[10]->incoming();
+    ASSERT_TRUE(in);
+    EXPECT_EQ(in->source_addr, 11);
+    EXPECT_EQ(strcmp((const char*) in->data->data(), test_string_2), 0);
+
+    // Hub own packages use learned routes too
+    hub->send(Buffer::create_from_string(test_string_3), 11);
+    hub->serve();
+    ASSERT_FALSE(leaf_physicals[11]->incoming().empty());
+    ASSERT_TRUE(leaf_physicals[10]->incoming().empty());
+    ASSERT_TRUE(leaf_physicals[12]->incoming().empty());
+
+    // Broadcasts are still flooded
+    hub->send(Buffer::create_from_string(test_string_3), 0xFF);
+    hub->serve();
+    ASSERT_FALSE(leaf_physicals[12]->incoming().empty());
+}
+
+TEST(RoutingTable, PrefersShorterAndFreshRoutes)
+{
+    RoutingTable::Options options;
+    options.route_timeout = 100ms;
+    RoutingTable table(options);
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+
+    // Copies of the same package, the one through interface 1 passed fewer relays
+    ASSERT_FALSE(table.find(5, now));
+    table.learn(5, 1, 0, 8, now);
+    table.learn(5, 1, 1, 9, now);
+    table.learn(5, 1, 0, 7, now + 10ms);
+    auto route = table.find(5, now + 20ms);
+    ASSERT_TRUE(route);
+    EXPECT_EQ(route->interface, 1u);
+
+    // Route is forgotten if it is not confirmed
+    ASSERT_FALSE(table.find(5, now + 100ms));
+    table.learn(5, 2, 0, 3, now + 200ms);
+    route = table.find(5, now + 200ms);
+    ASSERT_TRUE(route);
+    EXPECT_EQ(route->interface, 0u);
+}
+
+TEST(RoutingTable, HopLimitsOfDifferentPackagesAreNotCompared)
+{
+    RoutingTable table;
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+
+    // Package sent with big hop limit came through a long path of interface 0
+    table.learn(5, 1, 0, 250, now);
+    // Next package was sent with small hop limit and came first through interface 1
+    table.learn(5, 2, 1, 4, now + 10ms);
+    auto route = table.find(5, now + 10ms);
+    ASSERT_TRUE(route);
+    EXPECT_EQ(route->interface, 1u);
+
+    // Its later copy through the longer path does not replace the route
+    table.learn(5, 2, 0, 2, now + 20ms);
+    route = table.find(5, now + 20ms);
+    ASSERT_TRUE(route);
+    EXPECT_EQ(route->interface, 1u);
+}
+
+TEST_F(NetworkTest, DistanceVectorChoosesCheapestPath)
+{
+    auto det_sys = std::static_pointer_cast<SystemDriverDeterministic>(sys);
+    NetworkLayer::Options net_opts;
+    net_opts.routing.advertisement_period = 100ms;
+
+    // Node 1 reaches node 4 directly by expensive link or through cheap links via 2 and 3
+    std::map<uint64_t, std::shared_ptr<NetworkLayer>> nodes;
+    for (uint64_t addr = 1; addr <= 4; addr++)
+        nodes[addr] = std::make_shared<NetworkLayer>(sys, addr, net_opts);
+
+    std::map<std::pair<int, int>, std::shared_ptr<VirtualPhysicalInterface>> ends;
+    auto connect = [&](int a, int b, uint16_t cost) {
+        PhysicalInterfaceOptions opts;
+        opts.link_cost = cost;
+        auto link = std::make_shared<TransmissionMedium>();
+        ends[{a, b}] = VirtualPhysicalInterface::create(opts, sys, link);
+        ends[{b, a}] = VirtualPhysicalInterface::create(opts, sys, link);
+        nodes[a]->add_physical(ends[{a, b}]);
+        nodes[b]->add_physical(ends[{b, a}]);
+    };
+    connect(1, 4, 10);
+    connect(1, 2, 1);
+    connect(2, 3, 1);
+    connect(3, 4, 1);
+
+    for (int i = 0; i < 5; i++)
+    {
+        for (auto& node : nodes)
+            node.second->serve();
+        det_sys->increment_time(100ms);
+    }
+    for (auto& node : nodes)
+    {
+        node.second->serve();
+        while (node.second->incoming()) {}
+    }
+    for (auto& end : ends)
+        end.second->incoming().skip(end.second->incoming().size());
+
+    nodes[1]->send(Buffer::create_from_string(test_string_1), 4);
+    nodes[1]->serve();
+    ASSERT_TRUE(ends[std::make_pair(4, 1)]->incoming().empty());
+    ASSERT_FALSE(ends[std::make_pair(2, 1)]->incoming().empty());
+
+    std::optional<NetworkLayer::Package> in;
+    for (int i = 0; i < 3 && !in; i++)
+    {
+        for (auto& node : nodes)
+            node.second->serve();
+        in = nodes[4]->incoming();
+    }
+    ASSERT_TRUE(in);
+    EXPECT_EQ(in->source_addr, 1);
+    EXPECT_EQ(strcmp((const char*) in->data->data(), test_string_1), 0);
+}
+
+TEST_F(NetworkTest, AdvertisementsFitIncomingBuffers)
+{
+    auto det_sys = std::static_pointer_cast<SystemDriverDeterministic>(sys);
+    NetworkLayer::Options net_opts;
+    net_opts.routing.advertisement_period = 100ms;
+
+    // Node 9 tells node 1 about more routes than node 2 can receive in one frame
+    std::map<uint64_t, std::shared_ptr<NetworkLayer>> nodes;
+    for (uint64_t addr : {1, 2, 3, 9})
+        nodes[addr] = std::make_shared<NetworkLayer>(sys, addr, addr == 1 ? net_opts : NetworkLayer::Options());
+
+    std::map<std::pair<int, int>, std::shared_ptr<VirtualPhysicalInterface>> ends;
+    auto connect = [&](int a, int b, int ring_buffer_size) {
+        PhysicalInterfaceOptions opts;
+        opts.ring_buffer_size = ring_buffer_size;
+        // Receiver decodes every frame before the next one comes
+        opts.tx_time = 10ms;
+        auto link = std::make_shared<TransmissionMedium>();
+        ends[{a, b}] = VirtualPhysicalInterface::create(opts, sys, link);
+        ends[{b, a}] = VirtualPhysicalInterface::create(opts, sys, link);
+        nodes[a]->add_physical(ends[{a, b}]);
+        nodes[b]->add_physical(ends[{b, a}]);
+    };
+    connect(9, 1, 4096);
+    connect(1, 2, 1024);
+    connect(2, 3, 1024);
+
+    det_sys->increment_time(10ms);
+    nodes[9]->send(make_advertisement(100, 150, 9), RoutingTable::advertisement_addr, 0);
+    for (int i = 0; i < 30; i++)
+    {
+        for (auto& node : nodes)
+            node.second->serve();
+        det_sys->increment_time(10ms);
+    }
+    for (auto& node : nodes)
+    {
+        node.second->serve();
+        while (node.second->incoming()) {}
+    }
+    for (auto& end : ends)
+        end.second->incoming().skip(end.second->incoming().size());
+
+    // Node 2 learned every route, so it does not flood to node 3
+    for (uint64_t addr : {100, 249})
+    {
+        nodes[2]->send(Buffer::create_from_string(test_string_1), addr);
+        nodes[2]->serve();
+        EXPECT_TRUE(ends[std::make_pair(3, 2)]->incoming().empty()) << addr;
+        EXPECT_FALSE(ends[std::make_pair(1, 2)]->incoming().empty()) << addr;
+        ends[std::make_pair(1, 2)]->incoming().skip(ends[std::make_pair(1, 2)]->incoming().size());
+        det_sys->increment_time(100ms);
+    }
+}
+
+TEST(RoutingTable, AdvertisementsArePoisonedForNextHop)
+{
+    RoutingTable::Options options;
+    options.advertisement_period = 100ms;
+    RoutingTable far(options), neighbour(options), table(options);
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+
+    // Neighbour 7 knows node 8 with cost 5
+    auto far_advertisements = far.make_advertisements(8, now);
+    ASSERT_EQ(far_advertisements.size(), 1u);
+    neighbour.process_advertisement(far_advertisements[0], 7, 8, 0, 5, now);
+    auto advertisements = neighbour.make_advertisements(7, now);
+    ASSERT_EQ(advertisements.size(), 1u);
+    EXPECT_EQ(advertisements[0]->data()[0], 2);
+
+    table.process_advertisement(advertisements[0], 1, 7, 0, 2, now);
+    auto route = table.find(7, now);
+    ASSERT_TRUE(route);
+    EXPECT_EQ(route->cost, 2);
+    EXPECT_EQ(route->hops, 1);
+    EXPECT_EQ(table.hop_limit(7, 10, now), 1);
+    route = table.find(8, now);
+    ASSERT_TRUE(route);
+    EXPECT_EQ(route->cost, 7);
+    EXPECT_EQ(route->hops, 2);
+    EXPECT_EQ(route->next_hop, 7u);
+
+    // Routes through node 7 are advertised through the same interface, but node 7 ignores them
+    auto back = table.make_advertisements(1, now);
+    ASSERT_EQ(back.size(), 1u);
+    EXPECT_EQ(back[0]->data()[0], 3);
+    neighbour.process_advertisement(back[0], 7, 1, 0, 2, now);
+    route = neighbour.find(8, now);
+    ASSERT_TRUE(route);
+    EXPECT_EQ(route->cost, 5);
+    EXPECT_EQ(route->next_hop, 8u);
+
+    // Even when its own route is lost
+    auto later = now + options.route_timeout;
+    ASSERT_FALSE(neighbour.find(8, later));
+    neighbour.process_advertisement(back[0], 7, 1, 0, 2, later);
+    EXPECT_FALSE(neighbour.find(8, later));
+    ASSERT_TRUE(neighbour.find(1, later));
+}
+
+TEST(RoutingTable, AdvertisementsAreSplitBySize)
+{
+    RoutingTable::Options options;
+    options.advertisement_period = 100ms;
+    RoutingTable table(options), neighbour(options);
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+
+    table.process_advertisement(make_advertisement(100, 150, 3), 1, 2, 0, 1, now);
+    ASSERT_EQ(table.make_advertisements(1, now).size(), 1u);
+
+    const size_t max_size = 200;
+    auto advertisements = table.make_advertisements(1, now, max_size);
+    ASSERT_GT(advertisements.size(), 1u);
+    size_t entries = 0;
+    for (const auto& advertisement : advertisements)
+    {
+        EXPECT_LE(advertisement->size(), max_size);
+        entries += advertisement->data()[0];
+        neighbour.process_advertisement(advertisement, 5, 1, 0, 1, now);
+    }
+    EXPECT_EQ(entries, 151u);
+    for (uint64_t addr = 100; addr < 250; addr++)
+        ASSERT_TRUE(neighbour.find(addr, now)) << addr;
+}
+
+TEST(RoutingTable, DistanceVectorsPropagateOnSharedMedium)
+{
+    RoutingTable::Options options;
+    options.advertisement_period = 100ms;
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+
+    // Nodes 1 - 2 - 3 - 4 - 5 use the same single radio interface, every node hears only adjacent ones
+    const uint64_t first = 1, last = 5;
+    std::map<uint64_t, RoutingTable> tables;
+    for (uint64_t addr = first; addr <= last; addr++)
+        tables.emplace(addr, options);
+
+    for (int round = 0; round < 5; round++)
+    {
+        for (uint64_t addr = first; addr <= last; addr++)
+        {
+            for (const auto& advertisement : tables.at(addr).make_advertisements(addr, now))
+            {
+                for (uint64_t heard_by : {addr - 1, addr + 1})
+                {
+                    if (heard_by >= first && heard_by <= last)
+                        tables.at(heard_by).process_advertisement(advertisement, heard_by, addr, 0, 1, now);
+                }
+            }
+        }
+        now += options.advertisement_period;
+    }
+
+    auto route = tables.at(first).find(last, now);
+    ASSERT_TRUE(route);
+    EXPECT_EQ(route->interface, 0u);
+    EXPECT_EQ(route->cost, 4);
+    EXPECT_EQ(route->hops, 4);
+    EXPECT_EQ(route->next_hop, 2u);
+    EXPECT_EQ(tables.at(first).hop_limit(last, 10, now), 4);
+
+    route = tables.at(last).find(first, now);
+    ASSERT_TRUE(route);
+    EXPECT_EQ(route->hops, 4);
+    EXPECT_EQ(route->next_hop, 4u);
+}
+
+TEST_F(NetworkTest, OnlyElectedRelaysRetransmitFloods)
+{
+    auto det_sys = std::static_pointer_cast<SystemDriverDeterministic>(sys);
+    NetworkLayer::Options net_opts;
+    net_opts.relay_election.hello_period = 100ms;
+
+    // Nodes 1, 2, 3 share one radio medium and node 4 is reachable only through node 3
+    PhysicalInterfaceOptions radio;
+    radio.retransmit_back = true;
+    std::map<uint64_t, std::shared_ptr<NetworkLayer>> nodes;
+    std::map<uint64_t, std::shared_ptr<VirtualPhysicalInterface>> shared_ends;
+    auto far_link = std::make_shared<TransmissionMedium>();
+    std::shared_ptr<VirtualPhysicalInterface> far_end;
+    for (uint64_t addr = 1; addr <= 4; addr++)
+        nodes[addr] = std::make_shared<NetworkLayer>(sys, addr, net_opts);
+    for (uint64_t addr = 1; addr <= 3; addr++)
+    {
+        shared_ends[addr] = VirtualPhysicalInterface::create(radio, sys, medium);
+        nodes[addr]->add_physical(shared_ends[addr]);
+    }
+    nodes[3]->add_physical(VirtualPhysicalInterface::create(PhysicalInterfaceOptions(), sys, far_link));
+    far_end = VirtualPhysicalInterface::create(PhysicalInterfaceOptions(), sys, far_link);
+    nodes[4]->add_physical(far_end);
+
+    for (int i = 0; i < 3; i++)
+    {
+        for (auto& node : nodes)
+            node.second->serve();
+        det_sys->increment_time(100ms);
+    }
+    for (auto& node : nodes)
+        node.second->serve();
+    for (auto& end : shared_ends)
+        end.second->incoming().skip(end.second->incoming().size());
+    far_end->incoming().skip(far_end->incoming().size());
+
+    // Node 1 does not hear node 4, so package is flooded
+    nodes[1]->send(Buffer::create_from_string(test_string_1), 4);
+    nodes[1]->serve();
+    nodes[2]->serve();
+    nodes[3]->serve();
+
+    // Node 2 has no neighbours that node 1 does not hear, so it keeps silence
+    ASSERT_TRUE(shared_ends[1]->incoming().empty());
+    ASSERT_FALSE(far_end->incoming().empty());
+    nodes[4]->serve();
+    auto in = nodes[4]->incoming();
+    ASSERT_TRUE(in);
+    EXPECT_EQ(in->source_addr, 1);
+
+    // Node 4 answers, so node 2 knows that both 1 and 4 are behind its only interface
+    det_sys->increment_time(10ms);
+    nodes[4]->send(Buffer::create_from_string(test_string_2), 1);
+    nodes[4]->serve();
+    nodes[3]->serve();
+    nodes[2]->serve();
+    nodes[1]->serve();
+    in = nodes[1]->incoming();
+    ASSERT_TRUE(in);
+    EXPECT_EQ(in->source_addr, 4);
+    EXPECT_TRUE(shared_ends[3]->incoming().empty());
+
+    // Known route does not make node 2 a relay
+    det_sys->increment_time(10ms);
+    shared_ends[2]->incoming().skip(shared_ends[2]->incoming().size());
+    nodes[1]->send(Buffer::create_from_string(test_string_3), 4);
+    nodes[1]->serve();
+    nodes[2]->serve();
+    nodes[3]->serve();
+    EXPECT_TRUE(shared_ends[1]->incoming().empty());
+    nodes[4]->serve();
+    in = nodes[4]->incoming();
+    ASSERT_TRUE(in);
+    EXPECT_EQ(in->source_addr, 1);
+}
+
+TEST_F(NetworkTest, BoundedQueuesReportBackpressure)
+{
+    auto det_sys = std::static_pointer_cast<SystemDriverDeterministic>(sys);
+    PhysicalInterfaceOptions slow;
+    slow.tx_time = 100ms;
+
+    NetworkLayer::Options net_opts;
+    net_opts.tx_queue.limit = 4;
+    net_opts.tx_queue.codel.target = 200ms;
+    net_opts.tx_queue.codel.interval = 500ms;
+    auto sender = std::make_shared<NetworkLayer>(sys, 1, net_opts);
+    sender->add_physical(VirtualPhysicalInterface::create(slow, sys, medium));
+    auto receiver_phys = VirtualPhysicalInterface::create(slow, sys, medium);
+    auto receiver = std::make_shared<NetworkLayer>(sys, 2);
+    receiver->add_physical(receiver_phys);
+
+    ASSERT_FALSE(sender->congested());
+    for (int i = 0; i < 4; i++)
+        ASSERT_NE(sender->send(Buffer::create_from_string(test_string_1), 2), NetworkLayer::SendStatus::dropped);
+    ASSERT_TRUE(sender->congested());
+    ASSERT_EQ(sender->send(Buffer::create_from_string(test_string_1), 2), NetworkLayer::SendStatus::dropped);
+
+    // Slow link drains the queue and then it is not congested anymore
+    for (int i = 0; i < 10; i++)
+    {
+        sender->serve();
+        receiver->serve();
+        det_sys->increment_time(100ms);
+    }
+    ASSERT_FALSE(sender->congested());
+    int received = 0;
+    while (receiver->incoming())
+        received++;
+    EXPECT_EQ(received, 4);
+
+    // Standing queue makes sender see congestion before the queue is full
+    ASSERT_EQ(sender->send(Buffer::create_from_string(test_string_2), 2), NetworkLayer::SendStatus::queued);
+    sender->serve();
+    ASSERT_EQ(sender->send(Buffer::create_from_string(test_string_2), 2), NetworkLayer::SendStatus::queued);
+    det_sys->increment_time(200ms);
+    ASSERT_EQ(sender->send(Buffer::create_from_string(test_string_2), 2), NetworkLayer::SendStatus::congested);
+}
+
+TEST_F(NetworkTest, WaitingForwardedPackagesDoNotCongestOwnTraffic)
+{
+    auto det_sys = std::static_pointer_cast<SystemDriverDeterministic>(sys);
+    PhysicalInterfaceOptions slow;
+    slow.tx_time = 1000ms;
+
+    NetworkLayer::Options net_opts;
+    net_opts.tx_queue.codel.target = 100ms;
+    auto node = std::make_shared<NetworkLayer>(sys, 1, net_opts);
+    node->add_physical(VirtualPhysicalInterface::create(slow, sys, medium));
+    auto receiver = std::make_shared<NetworkLayer>(sys, 2);
+    receiver->add_physical(VirtualPhysicalInterface::create(slow, sys, medium));
+
+    // The first package occupies the link, the forwarded one waits longer than target
+    det_sys->increment_time(slow.tx_time);
+    node->send(Buffer::create_from_string(test_string_1), 2, NetworkLayer::default_hop_limit, TrafficClass::interactive);
+    node->serve();
+    node->send(Buffer::create_from_string(test_string_2), 2, NetworkLayer::default_hop_limit, TrafficClass::forwarded);
+    det_sys->increment_time(200ms);
+
+    EXPECT_TRUE(node->congested(TrafficClass::forwarded));
+    EXPECT_FALSE(node->congested(TrafficClass::interactive));
+    EXPECT_FALSE(node->congested(TrafficClass::bulk));
+    EXPECT_EQ(node->send(Buffer::create_from_string(test_string_3), 2, NetworkLayer::default_hop_limit, TrafficClass::interactive),
+              NetworkLayer::SendStatus::queued);
+}
@@ -0,0 +1,87 @@
+#include "ntdcp/relay-election.hpp"
+
+#include "gtest/gtest.h"
+
+#include <cstring>
+
+using namespace ntdcp;
+using namespace std::chrono_literals;
+
+namespace
+{
+
+Buffer::ptr hello(bool marked, std::vector<uint32_t> neighbours)
+{
+    Buffer::ptr result = Buffer::create(2 + neighbours.size() * sizeof(uint32_t));
+    result->data()[0] = marked ? 1 : 0;
+    result->data()[1] = uint8_t(neighbours.size());
+    memcpy(result->data() + 2, neighbours.data(), neighbours.size() * sizeof(uint32_t));
+    return result;
+}
+
+RelayElection::Options enabled_options()
+{
+    RelayElection::Options options;
+    options.hello_period = 100ms;
+    options.neighbour_timeout = 500ms;
+    return options;
+}
+
+}
+
+TEST(RelayElection, RelaysWithoutNeighbourhoodKnowledge)
+{
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+    RelayElection disabled(1);
+    ASSERT_TRUE(disabled.is_relay(now));
+
+    RelayElection election(1, enabled_options());
+    ASSERT_TRUE(election.is_relay(now));
+}
+
+TEST(RelayElection, Marking)
+{
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+
+    // Middle of chain 1 - 2 - 3
+    RelayElection middle(2, enabled_options());
+    middle.process_hello(1, hello(false, {2}), now);
+    middle.process_hello(3, hello(false, {2}), now);
+    ASSERT_TRUE(middle.is_relay(now));
+
+    // Everybody hears everybody
+    RelayElection clique(1, enabled_options());
+    clique.process_hello(2, hello(false, {1, 3}), now);
+    clique.process_hello(3, hello(false, {1, 2}), now);
+    ASSERT_FALSE(clique.is_relay(now));
+
+    // Neighbours are forgotten without HELLOs, so node relays again
+    ASSERT_TRUE(clique.is_relay(now + 500ms));
+}
+
+TEST(RelayElection, PruningRules)
+{
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+
+    // Rule 1: marked neighbour 4 covers all neighbours of 1
+    RelayElection covered(1, enabled_options());
+    covered.process_hello(2, hello(false, {1, 4}), now);
+    covered.process_hello(3, hello(false, {1, 4}), now);
+    covered.process_hello(4, hello(true, {1, 2, 3, 5}), now);
+    ASSERT_FALSE(covered.is_relay(now));
+
+    // Neighbour with smaller address does not prune
+    RelayElection bigger(6, enabled_options());
+    bigger.process_hello(2, hello(false, {6, 4}), now);
+    bigger.process_hello(3, hello(false, {6, 4}), now);
+    bigger.process_hello(4, hello(true, {6, 2, 3, 5}), now);
+    ASSERT_TRUE(bigger.is_relay(now));
+
+    // Rule 2: two connected marked neighbours 4 and 5 cover neighbours 2 and 3 of 1
+    RelayElection pair(1, enabled_options());
+    pair.process_hello(2, hello(false, {1, 4}), now);
+    pair.process_hello(3, hello(false, {1, 5}), now);
+    pair.process_hello(4, hello(true, {1, 2, 5, 6}), now);
+    pair.process_hello(5, hello(true, {1, 3, 4, 7}), now);
+    ASSERT_FALSE(pair.is_relay(now));
+}
@@ -344,3 +344,88 @@ TEST(TransoportLevel, NotStableTransmission)
     EXPECT_EQ(connections_requested, sim.get_accepted_sockets_count());
 }
 
+
+TEST(TransoportLevel, AcknowledgementsBypassCongestion)
+{
+    TransmissionMedium::ptr medium = std::make_shared<TransmissionMedium>();
+    std::shared_ptr<SystemDriverDeterministic> sys = std::make_shared<SystemDriverDeterministic>();
+
+    PhysicalInterfaceOptions opts;
+    NetworkLayer::Options net_opts;
+    net_opts.tx_queue.limit = 4;
+
+    NetworkLayer::ptr net1 = std::make_shared<NetworkLayer>(sys, 123);
+    net1->add_physical(VirtualPhysicalInterface::create(opts, sys, medium));
+    NetworkLayer::ptr net2 = std::make_shared<NetworkLayer>(sys, 321, net_opts);
+    net2->add_physical(VirtualPhysicalInterface::create(opts, sys, medium));
+
+    auto tr1 = std::make_shared<TransportLayer>(net1);
+    auto tr2 = std::make_shared<TransportLayer>(net2);
+
+    Socket initial_socket(*tr1, 321, 300, 10);
+    std::shared_ptr<Socket> accepted_socket;
+    Acceptor acc(*tr2, 10, [&accepted_socket](std::shared_ptr<Socket> sock) { accepted_socket = sock; });
+
+    auto exchange = [&]() {
+        tr1->serve();
+        net1->serve();
+        net2->serve();
+        tr2->serve();
+        net2->serve();
+        net1->serve();
+        tr1->serve();
+    };
+
+    Socket::Options default_socket_options;
+    initial_socket.connect();
+    exchange();
+    sys->increment_time(default_socket_options.force_ack_after + 1ms);
+    exchange();
+    ASSERT_TRUE(accepted_socket);
+    ASSERT_TRUE(initial_socket.state() == Socket::State::connected);
+    ASSERT_FALSE(accepted_socket->busy());
+
+    // Data is received and acknowledgement waits to be sent together with the answer
+    ASSERT_TRUE(initial_socket.send(Buffer::create_from_string(test_string_1)));
+    tr1->serve();
+    net1->serve();
+    net2->serve();
+    tr2->serve();
+    ASSERT_TRUE(accepted_socket->has_data());
+    ASSERT_TRUE(accepted_socket->send(Buffer::create_from_string(test_string_2)));
+
+    // Bulk traffic fills the transmit queue, so the answer is not picked
+    for (int i = 0; i < 4; i++)
+        net2->send(Buffer::create_from_string(test_string_3), 123);
+    ASSERT_TRUE(net2->congested());
+    sys->increment_time(default_socket_options.force_ack_after + 1ms);
+    tr2->serve();
+    net2->serve();
+
+    // Acknowledgement is sent anyway and goes ahead of bulk packages
+    net1->serve();
+    auto first = net1->incoming();
+    ASSERT_TRUE(first);
+    auto decoded = TransportLayer::decode(first->data);
+    ASSERT_TRUE(decoded);
+    EXPECT_TRUE(decoded->first.has_ack);
+    EXPECT_EQ(decoded->first.message_id, 0);
+    int bulk = 0;
+    while (auto in = net1->incoming())
+    {
+        EXPECT_EQ(strcmp((const char*) in->data->data(), test_string_3), 0);
+        bulk++;
+    }
+    EXPECT_EQ(bulk, 4);
+
+    // The answer is sent when the queue is drained
+    ASSERT_FALSE(net2->congested());
+    tr2->serve();
+    net2->serve();
+    net1->serve();
+    tr1->serve();
+    ASSERT_TRUE(initial_socket.has_data());
+    auto incoming = initial_socket.get_received();
+    ASSERT_TRUE(incoming.has_value());
+    EXPECT_EQ(strcmp((const char*) incoming.value()->data(), test_string_2), 0);
+}
@@ -0,0 +1,148 @@
+#include "ntdcp/tx-scheduler.hpp"
+
+#include "gtest/gtest.h"
+
+#include <map>
+#include <set>
+
+using namespace ntdcp;
+using namespace std::chrono_literals;
+
+namespace
+{
+
+SegmentBuffer package(uint8_t tag, size_t size = 100)
+{
+    Buffer::ptr buf = Buffer::create(size);
+    buf->data()[0] = tag;
+    return SegmentBuffer(buf);
+}
+
+uint8_t tag(SegmentBuffer package)
+{
+    return package.merge()->data()[0];
+}
+
+}
+
+TEST(TxScheduler, ControlHasStrictPriority)
+{
+    TxScheduler scheduler;
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+
+    ASSERT_TRUE(scheduler.push(TrafficClass::bulk, package(1), now));
+    ASSERT_TRUE(scheduler.push(TrafficClass::forwarded, package(2), now));
+    ASSERT_TRUE(scheduler.push(TrafficClass::control, package(3), now));
+    ASSERT_EQ(scheduler.size(), 3u);
+
+    ASSERT_NE(scheduler.peek(now), nullptr);
+    EXPECT_EQ(tag(scheduler.pop()), 3);
+
+    // Late control package overtakes the rest too
+    ASSERT_TRUE(scheduler.push(TrafficClass::control, package(4), now));
+    ASSERT_NE(scheduler.peek(now), nullptr);
+    EXPECT_EQ(tag(scheduler.pop()), 4);
+
+    std::set<uint8_t> rest;
+    while (scheduler.peek(now))
+        rest.insert(tag(scheduler.pop()));
+    EXPECT_EQ(rest, std::set<uint8_t>({1, 2}));
+    EXPECT_TRUE(scheduler.empty());
+    EXPECT_EQ(scheduler.bytes(), 0u);
+}
+
+TEST(TxScheduler, WeightedFairness)
+{
+    TxScheduler scheduler;
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+    for (int i = 0; i < 40; i++)
+    {
+        scheduler.push(TrafficClass::interactive, package(uint8_t(TrafficClass::interactive)), now);
+        scheduler.push(TrafficClass::bulk, package(uint8_t(TrafficClass::bulk)), now);
+        scheduler.push(TrafficClass::forwarded, package(uint8_t(TrafficClass::forwarded)), now);
+    }
+
+    // Bytes sent while every class has packages are proportional to weights 4:2:1
+    std::map<uint8_t, int> sent;
+    for (int i = 0; i < 35; i++)
+    {
+        ASSERT_NE(scheduler.peek(now), nullptr);
+        sent[tag(scheduler.pop())]++;
+    }
+    EXPECT_NEAR(sent[uint8_t(TrafficClass::interactive)], 20, 3);
+    EXPECT_NEAR(sent[uint8_t(TrafficClass::bulk)], 10, 3);
+    EXPECT_NEAR(sent[uint8_t(TrafficClass::forwarded)], 5, 3);
+}
+
+TEST(TxScheduler, LimitDoesNotApplyToControl)
+{
+    TxScheduler::Options options;
+    options.limit = 2;
+    TxScheduler scheduler(options);
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+
+    ASSERT_TRUE(scheduler.push(TrafficClass::bulk, package(1), now));
+    ASSERT_TRUE(scheduler.push(TrafficClass::interactive, package(2), now));
+    ASSERT_TRUE(scheduler.full());
+    ASSERT_FALSE(scheduler.push(TrafficClass::forwarded, package(3), now));
+    ASSERT_TRUE(scheduler.push(TrafficClass::control, package(4), now));
+    ASSERT_EQ(scheduler.size(), 3u);
+}
+
+TEST(TxScheduler, ControlQueueKeepsNewestPackages)
+{
+    TxScheduler::Options options;
+    options.control_limit = 3;
+    TxScheduler scheduler(options);
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+
+    // Link is down and HELLOs are queued every period
+    for (uint8_t i = 1; i <= 10; i++)
+        ASSERT_TRUE(scheduler.push(TrafficClass::control, package(i, 10), now + i * 100ms, true));
+    ASSERT_TRUE(scheduler.push(TrafficClass::bulk, package(11, 10), now));
+    EXPECT_EQ(scheduler.size(), 4u);
+    EXPECT_EQ(scheduler.bytes(), 40u);
+
+    std::vector<uint8_t> sent;
+    auto later = now + 1s;
+    while (scheduler.peek(later))
+        sent.push_back(tag(scheduler.pop()));
+    EXPECT_EQ(sent, std::vector<uint8_t>({8, 9, 10, 11}));
+
+    // Acknowledgement replaces the oldest HELLO, but is never replaced itself
+    ASSERT_TRUE(scheduler.push(TrafficClass::control, package(12, 10), later, true));
+    ASSERT_TRUE(scheduler.push(TrafficClass::control, package(13, 10), later));
+    ASSERT_TRUE(scheduler.push(TrafficClass::control, package(14, 10), later, true));
+    ASSERT_TRUE(scheduler.push(TrafficClass::control, package(15, 10), later));
+    ASSERT_TRUE(scheduler.push(TrafficClass::control, package(16, 10), later));
+    EXPECT_FALSE(scheduler.push(TrafficClass::control, package(17, 10), later));
+    EXPECT_FALSE(scheduler.push(TrafficClass::control, package(18, 10), later, true));
+    EXPECT_EQ(scheduler.size(), 3u);
+    EXPECT_EQ(scheduler.bytes(), 30u);
+
+    sent.clear();
+    while (scheduler.peek(later))
+        sent.push_back(tag(scheduler.pop()));
+    EXPECT_EQ(sent, std::vector<uint8_t>({13, 15, 16}));
+}
+
+TEST(TxScheduler, StalePackagesAreDroppedBeforeSending)
+{
+    TxScheduler::Options options;
+    options.codel.target = 10ms;
+    options.codel.interval = 100ms;
+    TxScheduler scheduler(options);
+    auto now = std::chrono::steady_clock::time_point() + 1h;
+
+    for (int i = 0; i < 50; i++)
+        scheduler.push(TrafficClass::bulk, package(uint8_t(i)), now);
+
+    size_t sent = 0;
+    for (int i = 0; scheduler.peek(now + 200ms + i * 10ms); i++)
+    {
+        scheduler.pop();
+        sent++;
+    }
+    EXPECT_TRUE(scheduler.empty());
+    EXPECT_LT(sent, 50u);
+}
@@ -0,0 +1,22 @@
+#include "ntdcp/worker-pool.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace ntdcp;
+
+TEST(WorkerPool, RunsEveryTaskOnce)
+{
+    for (size_t threads : {0, 1, 3})
+    {
+        WorkerPool pool(threads);
+        EXPECT_EQ(pool.threads_count(), threads);
+
+        for (size_t batch = 0; batch < 20; batch++)
+        {
+            std::vector<std::atomic<int>> calls(batch);
+            pool.run(calls.size(), [&calls](size_t i) { calls[i]++; });
+            for (const auto& count : calls)
+                ASSERT_EQ(count, 1);
+        }
+    }
+}